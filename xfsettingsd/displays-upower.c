@@ -146,6 +146,13 @@ xfce_displays_upower_property_changed (UpClient           *client,
 {
     gboolean lid_is_closed;
 
+#if UP_CHECK_VERSION(0, 99, 0)
+    /* only the lid matters here, ignore battery updates */
+    if (g_strcmp0 (pspec->name, "lid-is-closed") != 0
+        && g_strcmp0 (pspec->name, "lid-is-present") != 0)
+        return;
+#endif
+
     /* no lid, no chocolate */
     if (!up_client_get_lid_is_present (client))
         return;
@@ -160,3 +167,13 @@ xfce_displays_upower_property_changed (UpClient           *client,
         g_signal_emit (G_OBJECT (upower), signals[LID_CHANGED], 0, upower->lid_is_closed);
     }
 }
+
+
+
+gboolean
+xfce_displays_upower_get_lid_is_closed (XfceDisplaysUPower *upower)
+{
+    g_return_val_if_fail (XFCE_IS_DISPLAYS_UPOWER (upower), FALSE);
+
+    return upower->lid_is_closed;
+}
@@ -33,6 +33,8 @@ typedef struct _XfceDisplaysUPower      XfceDisplaysUPower;
 
 #define XFSD_LID_STR(b) (b ? "closed" : "open")
 
-GType xfce_displays_upower_get_type (void) G_GNUC_CONST;
+GType    xfce_displays_upower_get_type          (void) G_GNUC_CONST;
+
+gboolean xfce_displays_upower_get_lid_is_closed (XfceDisplaysUPower *upower);
 
 #endif /* !__DISPLAYS_UPOWER_H__ */
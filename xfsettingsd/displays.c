@@ -34,6 +34,7 @@
 #include <xfconf/xfconf.h>
 #include <libxfce4ui/libxfce4ui.h>
 
+#include <X11/Xatom.h>
 #include <X11/extensions/Xrandr.h>
 
 #include "debug.h"
@@ -52,16 +53,22 @@
 /* Xfconf properties */
 #define APPLY_SCHEME_PROP   "/Schemes/Apply"
 #define DEFAULT_SCHEME_NAME "Default"
-#define OUTPUT_FMT          "/%s/%s"
-#define PRIMARY_PROP        OUTPUT_FMT "/Primary"
-#define ACTIVE_PROP         OUTPUT_FMT "/Active"
-#define ROTATION_PROP       OUTPUT_FMT "/Rotation"
-#define REFLECTION_PROP     OUTPUT_FMT "/Reflection"
-#define RESOLUTION_PROP     OUTPUT_FMT "/Resolution"
-#define RRATE_PROP          OUTPUT_FMT "/RefreshRate"
-#define POSX_PROP           OUTPUT_FMT "/Position/X"
-#define POSY_PROP           OUTPUT_FMT "/Position/Y"
+/* per-output properties, relative to /<scheme>/<output> */
+#define PRIMARY_PROP        "/Primary"
+#define ACTIVE_PROP         "/Active"
+#define ROTATION_PROP       "/Rotation"
+#define REFLECTION_PROP     "/Reflection"
+#define RESOLUTION_PROP     "/Resolution"
+#define RRATE_PROP          "/RefreshRate"
+#define POSX_PROP           "/Position/X"
+#define POSY_PROP           "/Position/Y"
+#define EDID_PROP           "/EDID"
 #define NOTIFY_PROP         "/Notify"
+#define SETTLE_PROP         "/SettleMs"
+
+/* time to wait for the RandR events of a hotplug to calm down */
+#define SETTLE_DEFAULT_MS   500
+#define SETTLE_MAX_MS       5000
 
 
 
@@ -69,21 +76,46 @@
 typedef struct _XfceRRCrtc   XfceRRCrtc;
 typedef struct _XfceRROutput XfceRROutput;
 
+/* an output as saved in a scheme */
+typedef struct _XfceRRSavedOutput XfceRRSavedOutput;
+
 
 
 static void             xfce_displays_helper_dispose                        (GObject                 *object);
 static void             xfce_displays_helper_finalize                       (GObject                 *object);
 static void             xfce_displays_helper_reload                         (XfceDisplaysHelper      *helper);
+static void             xfce_displays_helper_index_crtcs                    (XfceDisplaysHelper      *helper);
+static void             xfce_displays_helper_index_outputs                  (XfceDisplaysHelper      *helper);
+static gboolean         xfce_displays_helper_output_removed                 (XfceDisplaysHelper      *helper,
+                                                                             XfceRROutput            *output);
+static void             xfce_displays_helper_outputs_changed                (XfceDisplaysHelper      *helper,
+                                                                             gboolean                 added,
+                                                                             gboolean                 removed,
+                                                                             gboolean                 removed_active);
+static void             xfce_displays_helper_queue_settle                   (XfceDisplaysHelper      *helper);
+static gboolean         xfce_displays_helper_outputs_settled                (gpointer                 data);
+static void             xfce_displays_helper_crtc_event                     (XfceDisplaysHelper      *helper,
+                                                                             XRRCrtcChangeNotifyEvent *e);
+static void             xfce_displays_helper_output_event                   (XfceDisplaysHelper      *helper,
+                                                                             XRROutputChangeNotifyEvent *e);
 static GdkFilterReturn  xfce_displays_helper_screen_on_event                (GdkXEvent               *xevent,
                                                                              GdkEvent                *event,
                                                                              gpointer                 data);
 static void             xfce_displays_helper_set_screen_size                (XfceDisplaysHelper      *helper);
+static GHashTable      *xfce_displays_helper_parse_scheme                   (XfceDisplaysHelper      *helper,
+                                                                             const gchar             *scheme);
 static gboolean         xfce_displays_helper_load_from_xfconf               (XfceDisplaysHelper      *helper,
-                                                                             const gchar             *scheme,
                                                                              GHashTable              *saved_outputs,
                                                                              XfceRROutput            *output);
+static void             xfce_displays_helper_index_modes                    (XfceDisplaysHelper      *helper);
+static XfceRROutput    *xfce_displays_helper_load_output                    (XfceDisplaysHelper      *helper,
+                                                                             RROutput                 id);
 static GPtrArray       *xfce_displays_helper_list_outputs                   (XfceDisplaysHelper      *helper);
 static void             xfce_displays_helper_free_output                    (XfceRROutput            *output);
+static XfceRRCrtc      *xfce_displays_helper_load_crtc                      (XfceDisplaysHelper      *helper,
+                                                                             RRCrtc                   id);
+static void             xfce_displays_helper_refresh_crtc                   (XfceRRCrtc              *crtc,
+                                                                             XfceDisplaysHelper      *helper);
 static GPtrArray       *xfce_displays_helper_list_crtcs                     (XfceDisplaysHelper      *helper);
 static XfceRRCrtc      *xfce_displays_helper_find_crtc_by_id                (XfceDisplaysHelper      *helper,
                                                                              RRCrtc                   id);
@@ -95,23 +127,35 @@ static void             xfce_displays_helper_get_topleftmost_pos            (Xfc
 static void             xfce_displays_helper_normalize_crtc                 (XfceRRCrtc              *crtc,
                                                                              XfceDisplaysHelper      *helper);
 static Status           xfce_displays_helper_disable_crtc                   (XfceDisplaysHelper      *helper,
-                                                                             RRCrtc                   crtc);
-static void             xfce_displays_helper_workaround_crtc_size           (XfceRRCrtc              *crtc,
-                                                                             XfceDisplaysHelper      *helper);
+                                                                             XfceRRCrtc              *crtc);
+static gboolean         xfce_displays_helper_plan                           (XfceDisplaysHelper      *helper,
+                                                                             GPtrArray               *disable,
+                                                                             GPtrArray               *configure,
+                                                                             gboolean                *resize);
 static void             xfce_displays_helper_apply_crtc                     (XfceRRCrtc              *crtc,
                                                                              XfceDisplaysHelper      *helper);
 static void             xfce_displays_helper_set_outputs                    (XfceRRCrtc              *crtc,
                                                                              XfceRROutput            *output);
-static void             xfce_displays_helper_apply_all                      (XfceDisplaysHelper      *helper);
-static void             xfce_displays_helper_channel_apply                  (XfceDisplaysHelper      *helper,
+static gboolean         xfce_displays_helper_apply_all                      (XfceDisplaysHelper      *helper);
+static gboolean         xfce_displays_helper_channel_load                   (XfceDisplaysHelper      *helper,
+                                                                             const gchar             *scheme);
+static gboolean         xfce_displays_helper_channel_apply                  (XfceDisplaysHelper      *helper,
+                                                                             const gchar             *scheme);
+static gchar           *xfce_displays_helper_fingerprint                    (XfceDisplaysHelper      *helper);
+static const gchar     *xfce_displays_helper_find_scheme                    (XfceDisplaysHelper      *helper);
+static void             xfce_displays_helper_store_fingerprint              (XfceDisplaysHelper      *helper,
                                                                              const gchar             *scheme);
 static void             xfce_displays_helper_channel_property_changed       (XfconfChannel           *channel,
                                                                              const gchar             *property_name,
                                                                              const GValue            *value,
                                                                              XfceDisplaysHelper      *helper);
-static void             xfce_displays_helper_toggle_internal                (gpointer                *power,
+static gboolean         xfce_displays_helper_toggle_internal                (XfceDisplaysHelper      *helper,
+                                                                             gboolean                 lid_is_closed);
+#ifdef HAVE_UPOWERGLIB
+static void             xfce_displays_helper_lid_changed                    (XfceDisplaysUPower      *power,
                                                                              gboolean                 lid_is_closed,
                                                                              XfceDisplaysHelper      *helper);
+#endif
 
 
 
@@ -138,16 +182,38 @@ struct _XfceDisplaysHelper
     gint                phandler;
 #endif
 
+    /* last known lid state, applied with the pending hotplug */
+    guint               lid_is_closed : 1;
+    guint               pending_lid : 1;
+
     GdkDisplay         *display;
     GdkWindow          *root_window;
     Display            *xdisplay;
     gint                event_base;
 
+    /* hotplug changes waiting for the settle window */
+    guint               settle_ms;
+    guint               settle_id;
+    guint               pending_added : 1;
+    guint               pending_removed : 1;
+    guint               pending_removed_active : 1;
+
     /* RandR cache */
     XRRScreenResources *resources;
     GPtrArray          *crtcs;
     GPtrArray          *outputs;
 
+    /* XID -> cached CRTC or output */
+    GHashTable         *crtc_index;
+    GHashTable         *output_index;
+
+    /* RRMode -> XRRModeInfo in resources */
+    GHashTable         *mode_index;
+
+    /* fingerprint of the connected outputs -> scheme, NULL until needed */
+    GHashTable         *fingerprints;
+    Atom                edid_atom;
+
     /* screen size */
     gint                width;
     gint                height;
@@ -174,6 +240,13 @@ struct _XfceRRCrtc
     gint      npossible;
     RROutput *possible;
     gint      changed;
+
+    /* configuration currently applied on the server */
+    RRMode    cur_mode;
+    gint      cur_width;
+    gint      cur_height;
+    gint      cur_x;
+    gint      cur_y;
 };
 
 struct _XfceRROutput
@@ -182,6 +255,26 @@ struct _XfceRROutput
     XRROutputInfo *info;
     RRMode         preferred_mode;
     guint          active : 1;
+
+    /* (width, height, rate) key -> XRRModeInfo of this output */
+    GHashTable    *modes;
+
+    /* checksum of the EDID, NULL if the output has none */
+    gchar         *edid;
+};
+
+struct _XfceRRSavedOutput
+{
+    guint     primary : 1;
+    guint     has_active : 1;
+    guint     active : 1;
+    Rotation  rotation;
+    gchar    *resolution;
+    guint     width;
+    guint     height;
+    gdouble   rate;
+    gint      x;
+    gint      y;
 };
 
 
@@ -210,15 +303,24 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
     helper->power = NULL;
     helper->phandler = 0;
 #endif
+    helper->lid_is_closed = FALSE;
+    helper->pending_lid = FALSE;
     helper->resources = NULL;
     helper->outputs = NULL;
     helper->crtcs = NULL;
+    helper->crtc_index = NULL;
+    helper->output_index = NULL;
+    helper->mode_index = NULL;
+    helper->fingerprints = NULL;
     helper->handler = 0;
+    helper->settle_id = 0;
 
     /* get the default display */
     helper->display = gdk_display_get_default ();
     helper->xdisplay = gdk_x11_display_get_xdisplay (helper->display);
     helper->root_window = gdk_get_default_root_window ();
+    helper->edid_atom = gdk_x11_get_xatom_by_name_for_display (helper->display,
+                                                               RR_PROPERTY_RANDR_EDID);
 
     /* check if the randr extension is running */
     if (XRRQueryExtension (helper->xdisplay, &helper->event_base, &error_base))
@@ -240,14 +342,19 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
                 return;
             }
 
-            /* get all existing CRTCs and connected outputs */
+            /* get all existing modes, CRTCs and connected outputs */
+            xfce_displays_helper_index_modes (helper);
             helper->crtcs = xfce_displays_helper_list_crtcs (helper);
+            xfce_displays_helper_index_crtcs (helper);
             helper->outputs = xfce_displays_helper_list_outputs (helper);
+            xfce_displays_helper_index_outputs (helper);
 
             /* Set up RandR notifications */
             XRRSelectInput (helper->xdisplay,
                             GDK_WINDOW_XID (helper->root_window),
-                            RRScreenChangeNotifyMask);
+                            RRScreenChangeNotifyMask
+                            | RRCrtcChangeNotifyMask
+                            | RROutputChangeNotifyMask);
             gdk_x11_register_standard_event_type (helper->display,
                                                   helper->event_base,
                                                   RRNotify + 1);
@@ -257,15 +364,20 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
 
 #ifdef HAVE_UPOWERGLIB
             helper->power = g_object_new (XFCE_TYPE_DISPLAYS_UPOWER, NULL);
+            helper->lid_is_closed = xfce_displays_upower_get_lid_is_closed (helper->power);
             helper->phandler = g_signal_connect (G_OBJECT (helper->power),
                                                  "lid-changed",
-                                                 G_CALLBACK (xfce_displays_helper_toggle_internal),
+                                                 G_CALLBACK (xfce_displays_helper_lid_changed),
                                                  helper);
 #endif
 
             /* open the channel */
             helper->channel = xfconf_channel_get ("displays");
 
+            helper->settle_ms = CLAMP (xfconf_channel_get_int (helper->channel, SETTLE_PROP,
+                                                               SETTLE_DEFAULT_MS),
+                                       0, SETTLE_MAX_MS);
+
             /* remove any leftover apply property before setting the monitor */
             xfconf_channel_reset_property (helper->channel, APPLY_SCHEME_PROP, FALSE);
 
@@ -323,6 +435,12 @@ xfce_displays_helper_dispose (GObject *object)
                               xfce_displays_helper_screen_on_event,
                               helper);
 
+    if (helper->settle_id != 0)
+    {
+        g_source_remove (helper->settle_id);
+        helper->settle_id = 0;
+    }
+
     if (helper->outputs)
     {
         g_ptr_array_unref (helper->outputs);
@@ -335,6 +453,30 @@ xfce_displays_helper_dispose (GObject *object)
         helper->crtcs = NULL;
     }
 
+    if (helper->output_index)
+    {
+        g_hash_table_unref (helper->output_index);
+        helper->output_index = NULL;
+    }
+
+    if (helper->crtc_index)
+    {
+        g_hash_table_unref (helper->crtc_index);
+        helper->crtc_index = NULL;
+    }
+
+    if (helper->mode_index)
+    {
+        g_hash_table_unref (helper->mode_index);
+        helper->mode_index = NULL;
+    }
+
+    if (helper->fingerprints)
+    {
+        g_hash_table_destroy (helper->fingerprints);
+        helper->fingerprints = NULL;
+    }
+
     (*G_OBJECT_CLASS (xfce_displays_helper_parent_class)->dispose) (object);
 }
 
@@ -398,8 +540,282 @@ xfce_displays_helper_reload (XfceDisplaysHelper *helper)
         g_critical ("Failed to reload the RandR cache (err: %d).", err);
 
     /* recreate the caches */
+    xfce_displays_helper_index_modes (helper);
     helper->crtcs = xfce_displays_helper_list_crtcs (helper);
+    xfce_displays_helper_index_crtcs (helper);
     helper->outputs = xfce_displays_helper_list_outputs (helper);
+    xfce_displays_helper_index_outputs (helper);
+}
+
+
+
+static void
+xfce_displays_helper_index_crtcs (XfceDisplaysHelper *helper)
+{
+    XfceRRCrtc *crtc;
+    guint       n;
+
+    if (helper->crtc_index)
+        g_hash_table_unref (helper->crtc_index);
+    helper->crtc_index = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    for (n = 0; n < helper->crtcs->len; ++n)
+    {
+        crtc = g_ptr_array_index (helper->crtcs, n);
+        g_hash_table_insert (helper->crtc_index, GUINT_TO_POINTER (crtc->id), crtc);
+    }
+}
+
+
+
+static void
+xfce_displays_helper_index_modes (XfceDisplaysHelper *helper)
+{
+    gint n;
+
+    if (helper->mode_index)
+        g_hash_table_unref (helper->mode_index);
+    helper->mode_index = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    for (n = 0; n < helper->resources->nmode; ++n)
+    {
+        g_hash_table_insert (helper->mode_index,
+                             GUINT_TO_POINTER (helper->resources->modes[n].id),
+                             &helper->resources->modes[n]);
+    }
+}
+
+
+
+static gint64
+xfce_displays_helper_mode_key (guint   width,
+                               guint   height,
+                               gdouble rate)
+{
+    /* the refresh rate is compared with one decimal, like in the dialog */
+    return ((gint64) (width & 0xfffff) << 40)
+           | ((gint64) (height & 0xfffff) << 20)
+           | ((gint64) rint (rate * 10) & 0xfffff);
+}
+
+
+
+static void
+xfce_displays_helper_index_outputs (XfceDisplaysHelper *helper)
+{
+    XfceRROutput *output;
+    guint         n;
+
+    /* the old table may still be referenced to diff against it */
+    if (helper->output_index)
+        g_hash_table_unref (helper->output_index);
+    helper->output_index = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    for (n = 0; n < helper->outputs->len; ++n)
+    {
+        output = g_ptr_array_index (helper->outputs, n);
+        g_hash_table_insert (helper->output_index, GUINT_TO_POINTER (output->id), output);
+    }
+}
+
+
+
+static gboolean
+xfce_displays_helper_output_removed (XfceDisplaysHelper *helper,
+                                     XfceRROutput       *output)
+{
+    XfceRRCrtc *crtc = NULL;
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Output disconnected: %s",
+                    output->info->name);
+
+    /* force deconfiguring the crtc for the removed output */
+    if (output->info->crtc != None)
+        crtc = xfce_displays_helper_find_crtc_by_id (helper, output->info->crtc);
+    if (crtc)
+    {
+        crtc->mode = None;
+        xfce_displays_helper_disable_crtc (helper, crtc);
+    }
+
+    /* if the output was active, we must recalculate the screen size */
+    return output->active;
+}
+
+
+
+static void
+xfce_displays_helper_outputs_changed (XfceDisplaysHelper *helper,
+                                      gboolean            added,
+                                      gboolean            removed,
+                                      gboolean            removed_active)
+{
+    helper->pending_added |= added;
+    helper->pending_removed |= removed;
+    helper->pending_removed_active |= removed_active;
+
+    xfce_displays_helper_queue_settle (helper);
+}
+
+
+
+static void
+xfce_displays_helper_queue_settle (XfceDisplaysHelper *helper)
+{
+    if (helper->settle_ms == 0)
+    {
+        xfce_displays_helper_outputs_settled (helper);
+        return;
+    }
+
+    /* restart the settle window, a (un)dock emits a burst of events */
+    if (helper->settle_id != 0)
+        g_source_remove (helper->settle_id);
+    helper->settle_id = g_timeout_add (helper->settle_ms,
+                                       xfce_displays_helper_outputs_settled,
+                                       helper);
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Change queued, waiting %u ms for more events.",
+                    helper->settle_ms);
+}
+
+
+
+static gboolean
+xfce_displays_helper_outputs_settled (gpointer data)
+{
+    XfceDisplaysHelper *helper = XFCE_DISPLAYS_HELPER (data);
+    XfceRROutput       *output;
+    const gchar        *scheme;
+    guint               n, nactive = 0;
+    gboolean            apply = FALSE, handled = FALSE;
+
+    helper->settle_id = 0;
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Outputs settled (added=%d, removed=%d, lid=%s).",
+                    helper->pending_added, helper->pending_removed,
+                    helper->pending_lid ? (helper->lid_is_closed ? "closed" : "open") : "unchanged");
+
+    /* a known combination of monitors, load its scheme directly */
+    if (helper->pending_added || helper->pending_removed)
+    {
+        scheme = xfce_displays_helper_find_scheme (helper);
+        if (scheme != NULL && xfce_displays_helper_channel_load (helper, scheme))
+        {
+            xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Outputs match scheme %s.", scheme);
+
+            /* the lid changed meanwhile, toggle the panel in the same apply */
+            if (helper->pending_lid)
+                xfce_displays_helper_toggle_internal (helper, helper->lid_is_closed);
+
+            /* a rejected scheme is handled like unknown monitors */
+            handled = xfce_displays_helper_apply_all (helper);
+        }
+    }
+
+    if (helper->pending_removed && !handled)
+    {
+        /* Basically, this means the external output was disconnected,
+           so reenable the internal one if needed. */
+        for (n = 0; n < helper->outputs->len; ++n)
+        {
+            output = g_ptr_array_index (helper->outputs, n);
+            if (output->active)
+                ++nactive;
+        }
+        if (nactive == 0)
+        {
+            xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "No active output anymore! "
+                            "Attempting to re-enable the internal output.");
+            apply |= xfce_displays_helper_toggle_internal (helper, FALSE);
+        }
+        else if (helper->pending_removed_active)
+            apply = TRUE;
+    }
+
+    /* the lid changed meanwhile, toggle the panel in the same apply */
+    if (helper->pending_lid && !handled)
+        apply |= xfce_displays_helper_toggle_internal (helper, helper->lid_is_closed);
+
+    if (apply)
+        xfce_displays_helper_apply_all (helper);
+
+    /* Start the minimal dialog according to the user preferences */
+    if (helper->pending_added && !handled
+        && xfconf_channel_get_bool (helper->channel, NOTIFY_PROP, FALSE))
+        xfce_spawn_command_line_on_screen (NULL, "xfce4-display-settings -m", FALSE,
+                                           FALSE, NULL);
+
+    helper->pending_added = FALSE;
+    helper->pending_removed = FALSE;
+    helper->pending_removed_active = FALSE;
+    helper->pending_lid = FALSE;
+
+    return FALSE;
+}
+
+
+
+static void
+xfce_displays_helper_crtc_event (XfceDisplaysHelper       *helper,
+                                 XRRCrtcChangeNotifyEvent *e)
+{
+    XfceRRCrtc *crtc;
+
+    crtc = xfce_displays_helper_find_crtc_by_id (helper, e->crtc);
+    if (crtc == NULL)
+    {
+        /* unknown CRTC, the resources changed and a RRScreenChangeNotify follows */
+        return;
+    }
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "CRTC %lu changed: mode=%lu, pos=%dx%d.",
+                    e->crtc, e->mode, e->x, e->y);
+
+    /* only refresh this CRTC, the event doesn't carry its outputs */
+    xfce_displays_helper_refresh_crtc (crtc, helper);
+}
+
+
+
+static void
+xfce_displays_helper_output_event (XfceDisplaysHelper         *helper,
+                                   XRROutputChangeNotifyEvent *e)
+{
+    XfceRROutput *output;
+    gboolean      removed_active;
+
+    output = g_hash_table_lookup (helper->output_index, GUINT_TO_POINTER (e->output));
+
+    if (output == NULL && e->connection == RR_Connected)
+    {
+        output = xfce_displays_helper_load_output (helper, e->output);
+        if (output == NULL)
+            return;
+
+        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "New output connected: %s",
+                        output->info->name);
+
+        g_ptr_array_add (helper->outputs, output);
+        g_hash_table_insert (helper->output_index, GUINT_TO_POINTER (output->id), output);
+
+        xfce_displays_helper_outputs_changed (helper, TRUE, FALSE, FALSE);
+    }
+    else if (output != NULL && e->connection != RR_Connected)
+    {
+        removed_active = xfce_displays_helper_output_removed (helper, output);
+
+        g_hash_table_remove (helper->output_index, GUINT_TO_POINTER (output->id));
+        g_ptr_array_remove (helper->outputs, output);
+
+        xfce_displays_helper_outputs_changed (helper, FALSE, TRUE, removed_active);
+    }
+    else if (output != NULL)
+    {
+        /* update the CRTC assignment in place */
+        output->info->crtc = e->crtc;
+        output->active = e->crtc != None && e->mode != None;
+    }
 }
 
 
@@ -411,12 +827,13 @@ xfce_displays_helper_screen_on_event (GdkXEvent *xevent,
 {
     XfceDisplaysHelper *helper = XFCE_DISPLAYS_HELPER (data);
     GPtrArray          *old_outputs;
-    XfceRRCrtc         *crtc = NULL;
-    XfceRROutput       *output, *o;
+    GHashTable         *old_index;
+    XfceRROutput       *output;
     XEvent             *e = xevent;
+    XRRNotifyEvent     *ne;
     gint                event_num;
-    guint               n, m, nactive = 0;
-    gboolean            found = FALSE, changed = FALSE;
+    guint               n;
+    gboolean            added = FALSE, removed = FALSE, removed_active = FALSE;
 
     if (!e)
         return GDK_FILTER_CONTINUE;
@@ -427,85 +844,58 @@ xfce_displays_helper_screen_on_event (GdkXEvent *xevent,
     {
         xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "RRScreenChangeNotify event received.");
 
+        /* CRTC and output changes are tracked through RRNotify, only
+         * reload everything when the configuration itself changed */
+        if (((XRRScreenChangeNotifyEvent *) e)->config_timestamp
+            == helper->resources->configTimestamp)
+        {
+            xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Configuration unchanged, keeping the RandR cache.");
+            return GDK_FILTER_CONTINUE;
+        }
+
         old_outputs = g_ptr_array_ref (helper->outputs);
+        old_index = g_hash_table_ref (helper->output_index);
         xfce_displays_helper_reload (helper);
 
         xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Noutput: before = %d, after = %d.",
                         old_outputs->len, helper->outputs->len);
 
-        if (old_outputs->len > helper->outputs->len)
+        /* Diff the new and old output list to find removed outputs */
+        for (n = 0; n < old_outputs->len; ++n)
         {
-            /* Diff the new and old output list to find removed outputs */
-            for (n = 0; n < old_outputs->len; ++n)
-            {
-                found = FALSE;
-                output = g_ptr_array_index (old_outputs, n);
-                for (m = 0; m < helper->outputs->len && !found; ++m)
-                {
-                    o = g_ptr_array_index (helper->outputs, m);
-                    found = o->id == output->id;
-                }
-                if (!found)
-                {
-                    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Output disconnected: %s",
-                                    output->info->name);
-                    /* force deconfiguring the crtc for the removed output */
-                    if (output->info->crtc != None)
-                        crtc = xfce_displays_helper_find_crtc_by_id (helper,
-                                                                     output->info->crtc);
-                    if (crtc)
-                    {
-                        crtc->mode = None;
-                        xfce_displays_helper_disable_crtc (helper, crtc->id);
-                    }
-                    /* if the output was active, we must recalculate the screen size */
-                    changed |= output->active;
-                }
-            }
-
-            /* Basically, this means the external output was disconnected,
-               so reenable the internal one if needed. */
-            for (n = 0; n < helper->outputs->len; ++n)
+            output = g_ptr_array_index (old_outputs, n);
+            if (!g_hash_table_lookup (helper->output_index, GUINT_TO_POINTER (output->id)))
             {
-                output = g_ptr_array_index (helper->outputs, n);
-                if (output->active)
-                    ++nactive;
+                removed = TRUE;
+                removed_active |= xfce_displays_helper_output_removed (helper, output);
             }
-            if (nactive == 0)
-            {
-                xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "No active output anymore! "
-                                "Attempting to re-enable the internal output.");
-                xfce_displays_helper_toggle_internal (NULL, FALSE, helper);
-            }
-            else if (changed)
-                xfce_displays_helper_apply_all (helper);
         }
-        else
+
+        /* Diff the new and old output list to find new outputs */
+        for (n = 0; n < helper->outputs->len; ++n)
         {
-            /* Diff the new and old output list to find new outputs */
-            for (n = 0; n < helper->outputs->len; ++n)
+            output = g_ptr_array_index (helper->outputs, n);
+            if (!g_hash_table_lookup (old_index, GUINT_TO_POINTER (output->id)))
             {
-                found = FALSE;
-                output = g_ptr_array_index (helper->outputs, n);
-                for (m = 0; m < old_outputs->len && !found; ++m)
-                {
-                    o = g_ptr_array_index (old_outputs, m);
-                    found = o->id == output->id;
-                }
-                if (!found)
-                {
-                    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "New output connected: %s",
-                                    output->info->name);
-                    changed = TRUE;
-                }
+                xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "New output connected: %s",
+                                output->info->name);
+                added = TRUE;
             }
-            /* Start the minimal dialog according to the user preferences */
-            if (changed && xfconf_channel_get_bool (helper->channel, NOTIFY_PROP, FALSE))
-                xfce_spawn_command_line_on_screen (NULL, "xfce4-display-settings -m", FALSE,
-                                                   FALSE, NULL);
         }
+
+        xfce_displays_helper_outputs_changed (helper, added, removed, removed_active);
+
+        g_hash_table_unref (old_index);
         g_ptr_array_unref (old_outputs);
     }
+    else if (event_num == RRNotify)
+    {
+        ne = (XRRNotifyEvent *) e;
+        if (ne->subtype == RRNotify_CrtcChange)
+            xfce_displays_helper_crtc_event (helper, (XRRCrtcChangeNotifyEvent *) e);
+        else if (ne->subtype == RRNotify_OutputChange)
+            xfce_displays_helper_output_event (helper, (XRROutputChangeNotifyEvent *) e);
+    }
 
     /* Pass the event on to GTK+ */
     return GDK_FILTER_CONTINUE;
@@ -516,87 +906,189 @@ xfce_displays_helper_screen_on_event (GdkXEvent *xevent,
 static void
 xfce_displays_helper_set_screen_size (XfceDisplaysHelper *helper)
 {
-    gint min_width, min_height, max_width, max_height;
-
     g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
 
-    /* get the screen size extremums */
-    if (!XRRGetScreenSizeRange (helper->xdisplay, GDK_WINDOW_XID (helper->root_window),
-                                &min_width, &min_height, &max_width, &max_height))
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Applying desktop dimensions: %dx%d (px), %dx%d (mm).",
+                    helper->width, helper->height, helper->mm_width, helper->mm_height);
+    XRRSetScreenSize (helper->xdisplay, GDK_WINDOW_XID (helper->root_window),
+                      helper->width, helper->height, helper->mm_width, helper->mm_height);
+}
+
+
+
+static void
+xfce_displays_helper_free_saved_output (XfceRRSavedOutput *saved)
+{
+    g_free (saved->resolution);
+    g_slice_free (XfceRRSavedOutput, saved);
+}
+
+
+
+static GHashTable *
+xfce_displays_helper_parse_scheme (XfceDisplaysHelper *helper,
+                                   const gchar        *scheme)
+{
+    GHashTable        *properties, *saved_outputs;
+    GHashTableIter     iter;
+    XfceRRSavedOutput *saved;
+    gpointer           key;
+    GValue            *value;
+    const gchar       *name, *field, *str_value;
+    gchar             *prefix, *output_name, *end;
+    gsize              prefix_len;
+    guint64            width, height;
+
+    /* the list of saved outputs from xfconf */
+    prefix = g_strdup_printf ("/%s", scheme);
+    properties = xfconf_channel_get_properties (helper->channel, prefix);
+    if (properties == NULL)
     {
-        g_warning ("Unable to get the range of screen sizes. "
-                   "Display settings may fail to apply.");
-        return;
+        g_free (prefix);
+        return NULL;
     }
 
-    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "min_h = %d, min_w = %d, max_h = %d, max_w = %d, "
-                    "prev_h = %d, prev_w = %d, prev_hmm = %d, prev_wmm = %d, h = %d, w = %d, "
-                    "hmm = %d, wmm = %d.", min_height, min_width, max_height, max_width,
-                    gdk_screen_height (), gdk_screen_width (), gdk_screen_height_mm (),
-                    gdk_screen_width_mm (), helper->height, helper->width, helper->mm_height,
-                    helper->mm_width);
+    saved_outputs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify) xfce_displays_helper_free_saved_output);
 
-    /* set the screen size only if it's really needed and valid */
-    if (helper->width >= min_width && helper->width <= max_width
-        && helper->height >= min_height && helper->height <= max_height
-        && (helper->width != gdk_screen_width ()
-            || helper->height != gdk_screen_height ()
-            || helper->mm_width != gdk_screen_width_mm ()
-            || helper->mm_height != gdk_screen_height_mm ()))
-    {
-        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Applying desktop dimensions: %dx%d (px), %dx%d (mm).",
-                        helper->width, helper->height, helper->mm_width, helper->mm_height);
-        XRRSetScreenSize (helper->xdisplay, GDK_WINDOW_XID (helper->root_window),
-                          helper->width, helper->height, helper->mm_width, helper->mm_height);
+    /* an output exists in the scheme if /<scheme>/<output> is a string */
+    prefix_len = strlen (prefix);
+    g_hash_table_iter_init (&iter, properties);
+    while (g_hash_table_iter_next (&iter, &key, (gpointer *) &value))
+    {
+        name = (const gchar *) key + prefix_len;
+        if (*name++ != '/' || strchr (name, '/') != NULL || !G_VALUE_HOLDS_STRING (value))
+            continue;
+
+        saved = g_slice_new0 (XfceRRSavedOutput);
+        saved->rotation = RR_Rotate_0;
+        g_hash_table_insert (saved_outputs, g_strdup (name), saved);
+    }
+
+    /* then walk all the properties of these outputs once */
+    g_hash_table_iter_init (&iter, properties);
+    while (g_hash_table_iter_next (&iter, &key, (gpointer *) &value))
+    {
+        name = (const gchar *) key + prefix_len;
+        if (*name++ != '/' || (field = strchr (name, '/')) == NULL)
+            continue;
+
+        output_name = g_strndup (name, field - name);
+        saved = g_hash_table_lookup (saved_outputs, output_name);
+        g_free (output_name);
+
+        if (saved == NULL)
+            continue;
+
+        if (strcmp (field, PRIMARY_PROP) == 0)
+        {
+            saved->primary = G_VALUE_HOLDS_BOOLEAN (value) && g_value_get_boolean (value);
+        }
+        else if (strcmp (field, ACTIVE_PROP) == 0)
+        {
+            saved->has_active = G_VALUE_HOLDS_BOOLEAN (value);
+            saved->active = saved->has_active && g_value_get_boolean (value);
+        }
+        else if (strcmp (field, ROTATION_PROP) == 0 && G_VALUE_HOLDS_INT (value))
+        {
+            /* convert to a Rotation, keeping the reflection bits */
+            saved->rotation &= (RR_Reflect_X|RR_Reflect_Y);
+            switch (g_value_get_int (value))
+            {
+                case 90:  saved->rotation |= RR_Rotate_90;  break;
+                case 180: saved->rotation |= RR_Rotate_180; break;
+                case 270: saved->rotation |= RR_Rotate_270; break;
+                default:  saved->rotation |= RR_Rotate_0;   break;
+            }
+        }
+        else if (strcmp (field, REFLECTION_PROP) == 0 && G_VALUE_HOLDS_STRING (value))
+        {
+            /* convert to a Rotation, keeping the rotation bits */
+            saved->rotation &= ~(RR_Reflect_X|RR_Reflect_Y);
+            str_value = g_value_get_string (value);
+            if (g_strcmp0 (str_value, "X") == 0)
+                saved->rotation |= RR_Reflect_X;
+            else if (g_strcmp0 (str_value, "Y") == 0)
+                saved->rotation |= RR_Reflect_Y;
+            else if (g_strcmp0 (str_value, "XY") == 0)
+                saved->rotation |= (RR_Reflect_X|RR_Reflect_Y);
+        }
+        else if (strcmp (field, RESOLUTION_PROP) == 0 && G_VALUE_HOLDS_STRING (value))
+        {
+            /* same format as the mode names generated in the dialog */
+            str_value = g_value_get_string (value);
+            g_free (saved->resolution);
+            saved->resolution = g_strdup (str_value);
+            saved->width = saved->height = 0;
+            if (str_value != NULL)
+            {
+                width = g_ascii_strtoull (str_value, &end, 10);
+                if (end != str_value && *end == 'x')
+                {
+                    str_value = end + 1;
+                    height = g_ascii_strtoull (str_value, &end, 10);
+                    if (end != str_value && *end == '\0')
+                    {
+                        saved->width = width;
+                        saved->height = height;
+                    }
+                }
+            }
+        }
+        else if (strcmp (field, RRATE_PROP) == 0 && G_VALUE_HOLDS_DOUBLE (value))
+        {
+            saved->rate = g_value_get_double (value);
+        }
+        else if (strcmp (field, POSX_PROP) == 0 && G_VALUE_HOLDS_INT (value))
+        {
+            saved->x = g_value_get_int (value);
+        }
+        else if (strcmp (field, POSY_PROP) == 0 && G_VALUE_HOLDS_INT (value))
+        {
+            saved->y = g_value_get_int (value);
+        }
     }
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Parsed %d output(s) of scheme %s.",
+                    g_hash_table_size (saved_outputs), scheme);
+
+    g_hash_table_destroy (properties);
+    g_free (prefix);
+
+    return saved_outputs;
 }
 
 
 
 static gboolean
 xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
-                                       const gchar        *scheme,
                                        GHashTable         *saved_outputs,
                                        XfceRROutput       *output)
 {
-    XfceRRCrtc  *crtc = NULL;
-    GValue      *value;
-    const gchar *str_value;
-    gchar        property[512];
-    gdouble      output_rate, rate;
-    RRMode       valid_mode;
-    Rotation     rot;
-    gint         x, y, n, m, int_value;
-    gboolean     active;
+    XfceRRCrtc        *crtc = NULL;
+    XfceRRSavedOutput *saved;
+    XRRModeInfo       *mode_info;
+    Rotation           rot;
+    gint64             key;
+    gboolean           active;
 
     g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->resources && output);
 
     active = output->active;
 
     /* does this output exist in xfconf? */
-    g_snprintf (property, sizeof (property), OUTPUT_FMT, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-
-    if (value == NULL || !G_VALUE_HOLDS_STRING (value))
+    saved = g_hash_table_lookup (saved_outputs, output->info->name);
+    if (saved == NULL)
         return active;
 
 #ifdef HAS_RANDR_ONE_POINT_THREE
-    if (helper->has_1_3)
-    {
-        /* is it the primary output? */
-        g_snprintf (property, sizeof (property), PRIMARY_PROP, scheme,
-                    output->info->name);
-        value = g_hash_table_lookup (saved_outputs, property);
-        if (G_VALUE_HOLDS_BOOLEAN (value) && g_value_get_boolean (value))
-            helper->primary = output->id;
-    }
+    /* is it the primary output? */
+    if (helper->has_1_3 && saved->primary)
+        helper->primary = output->id;
 #endif
 
     /* status */
-    g_snprintf (property, sizeof (property), ACTIVE_PROP, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-
-    if (value == NULL || !G_VALUE_HOLDS_BOOLEAN (value))
+    if (!saved->has_active)
         return active;
 
     /* Get the associated CRTC */
@@ -605,7 +1097,7 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
         return active;
 
     /* disable inactive outputs */
-    if (!g_value_get_boolean (value))
+    if (!saved->active)
     {
         if (crtc->mode != None)
         {
@@ -620,40 +1112,8 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
         return active;
     }
 
-    /* rotation */
-    g_snprintf (property, sizeof (property), ROTATION_PROP, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (G_VALUE_HOLDS_INT (value))
-        int_value = g_value_get_int (value);
-    else
-        int_value = 0;
-
-    /* convert to a Rotation */
-    switch (int_value)
-    {
-        case 90:  rot = RR_Rotate_90;  break;
-        case 180: rot = RR_Rotate_180; break;
-        case 270: rot = RR_Rotate_270; break;
-        default:  rot = RR_Rotate_0;   break;
-    }
-
-    /* reflection */
-    g_snprintf (property, sizeof (property), REFLECTION_PROP, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (G_VALUE_HOLDS_STRING (value))
-        str_value = g_value_get_string (value);
-    else
-        str_value = "0";
-
-    /* convert to a Rotation */
-    if (g_strcmp0 (str_value, "X") == 0)
-        rot |= RR_Reflect_X;
-    else if (g_strcmp0 (str_value, "Y") == 0)
-        rot |= RR_Reflect_Y;
-    else if (g_strcmp0 (str_value, "XY") == 0)
-        rot |= (RR_Reflect_X|RR_Reflect_Y);
-
     /* check rotation support */
+    rot = saved->rotation;
     if ((crtc->rotations & rot) == 0)
     {
         g_warning ("Unsupported rotation for %s. Fallback to RR_Rotate_0.", output->info->name);
@@ -667,107 +1127,45 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
         crtc->changed = TRUE;
     }
 
-    /* resolution */
-    g_snprintf (property, sizeof (property), RESOLUTION_PROP, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (value == NULL || !G_VALUE_HOLDS_STRING (value))
-        str_value = "";
-    else
-        str_value = g_value_get_string (value);
-
-    /* refresh rate */
-    g_snprintf (property, sizeof (property), RRATE_PROP, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (G_VALUE_HOLDS_DOUBLE (value))
-        output_rate = g_value_get_double (value);
-    else
-        output_rate = 0.0;
+    /* find the mode corresponding to the saved values */
+    key = xfce_displays_helper_mode_key (saved->width, saved->height, saved->rate);
+    mode_info = g_hash_table_lookup (output->modes, &key);
 
-    /* check mode validity */
-    valid_mode = None;
-    for (n = 0; n < output->info->nmode; ++n)
-    {
-        /* walk all modes */
-        for (m = 0; m < helper->resources->nmode; ++m)
-        {
-            /* does the mode info match the mode we seek? */
-            if (helper->resources->modes[m].id != output->info->modes[n])
-                continue;
-
-            /* calculate the refresh rate */
-            rate = (gdouble) helper->resources->modes[m].dotClock /
-                    ((gdouble) helper->resources->modes[m].hTotal * (gdouble) helper->resources->modes[m].vTotal);
-
-            /* construct a string equivalent to the mode generated in displays */
-            /* property is the resources mode translated into display panel name */
-            g_snprintf (property, sizeof (property), "%dx%d", helper->resources->modes[m].width,
-                        helper->resources->modes[m].height);
-
-            /* find the mode corresponding to the saved values */
-            if (rint (rate * 10) == rint (output_rate * 10)
-                && (g_strcmp0 (property, str_value) == 0))
-            {
-                valid_mode = helper->resources->modes[m].id;
-                break;
-            }
-        }
-        /* found it */
-        if (valid_mode != None)
-            break;
-    }
-
-    if (valid_mode == None)
+    if (mode_info == NULL)
     {
         /* unsupported mode, abort for this output */
         g_warning ("Unknown mode '%s @ %.1f' for output %s, aborting.",
-                   str_value, output_rate, output->info->name);
+                   saved->resolution != NULL ? saved->resolution : "",
+                   saved->rate, output->info->name);
         return active;
     }
-    else if (crtc->mode != valid_mode)
+    else if (crtc->mode != mode_info->id)
     {
         if (crtc->mode == None)
             active = TRUE;
 
         /* update CRTC mode */
-        crtc->mode = valid_mode;
+        crtc->mode = mode_info->id;
         crtc->changed = TRUE;
     }
 
     /* recompute dimensions according to the selected rotation */
     if ((crtc->rotation & (RR_Rotate_90|RR_Rotate_270)) != 0)
     {
-        crtc->width = helper->resources->modes[m].height;
-        crtc->height = helper->resources->modes[m].width;
+        crtc->width = mode_info->height;
+        crtc->height = mode_info->width;
     }
     else
     {
-        crtc->width = helper->resources->modes[m].width;
-        crtc->height = helper->resources->modes[m].height;
+        crtc->width = mode_info->width;
+        crtc->height = mode_info->height;
     }
 
-    /* position, x */
-    g_snprintf (property, sizeof (property), POSX_PROP, scheme,
-                output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (G_VALUE_HOLDS_INT (value))
-        x = g_value_get_int (value);
-    else
-        x = 0;
-
-    /* position, y */
-    g_snprintf (property, sizeof (property), POSY_PROP, scheme,
-                output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (G_VALUE_HOLDS_INT (value))
-        y = g_value_get_int (value);
-    else
-        y = 0;
-
     /* update CRTC position */
-    if (crtc->x != x || crtc->y != y)
+    if (crtc->x != saved->x || crtc->y != saved->y)
     {
-        crtc->x = x;
-        crtc->y = y;
+        crtc->x = saved->x;
+        crtc->y = saved->y;
         crtc->changed = TRUE;
     }
 
@@ -778,86 +1176,134 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
 
 
 
-static GPtrArray *
-xfce_displays_helper_list_outputs (XfceDisplaysHelper *helper)
+static XfceRROutput *
+xfce_displays_helper_load_output (XfceDisplaysHelper *helper,
+                                  RROutput            id)
 {
-    GPtrArray     *outputs;
     XRROutputInfo *output_info;
     XfceRROutput  *output;
     XfceRRCrtc    *crtc;
-    gint           best_dist, dist, n, m, l, err;
+    XRRModeInfo   *mode_info;
+    gint64         key;
+    gdouble        rate;
+    gint           best_dist, dist, l, err;
+    guchar        *prop;
+    gint           actual_format;
+    gulong         nitems, bytes_after;
+    Atom           actual_type;
 
     g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
 
-    outputs = g_ptr_array_new ();
+    gdk_error_trap_push ();
+    output_info = XRRGetOutputInfo (helper->xdisplay, helper->resources, id);
+    gdk_flush ();
+    err = gdk_error_trap_pop ();
+    if (err || !output_info)
+    {
+        g_warning ("Failed to load info for output %lu (err: %d). Skipping.",
+                   id, err);
+        return NULL;
+    }
+
+    if (output_info->connection != RR_Connected)
+    {
+        XRRFreeOutputInfo (output_info);
+        return NULL;
+    }
 
-    /* get all connected outputs */
-    outputs = g_ptr_array_new_with_free_func ((GDestroyNotify) xfce_displays_helper_free_output);
-    for (n = 0; n < helper->resources->noutput; ++n)
+    output = g_new0 (XfceRROutput, 1);
+    output->id = id;
+    output->info = output_info;
+
+    /* index the modes of the output, the first one wins */
+    output->modes = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+
+    /* find the preferred mode */
+    output->preferred_mode = None;
+    best_dist = 0;
+    for (l = 0; l < output->info->nmode; ++l)
     {
-        gdk_error_trap_push ();
-        output_info = XRRGetOutputInfo (helper->xdisplay, helper->resources, helper->resources->outputs[n]);
-        gdk_flush ();
-        err = gdk_error_trap_pop ();
-        if (err || !output_info)
-        {
-            g_warning ("Failed to load info for output %lu (err: %d). Skipping.",
-                       helper->resources->outputs[n], err);
+        mode_info = g_hash_table_lookup (helper->mode_index,
+                                         GUINT_TO_POINTER (output->info->modes[l]));
+        if (mode_info == NULL)
             continue;
+
+        /* calculate the refresh rate */
+        rate = (gdouble) mode_info->dotClock /
+                ((gdouble) mode_info->hTotal * (gdouble) mode_info->vTotal);
+
+        key = xfce_displays_helper_mode_key (mode_info->width, mode_info->height, rate);
+        if (!g_hash_table_lookup (output->modes, &key))
+            g_hash_table_insert (output->modes, g_memdup (&key, sizeof (key)), mode_info);
+
+        if (l < output->info->npreferred)
+            dist = 0;
+        else if (output->info->mm_height != 0)
+            dist = (1000 * gdk_screen_height () / gdk_screen_height_mm () -
+                    1000 * mode_info->height / output->info->mm_height);
+        else
+            dist = gdk_screen_height () - mode_info->height;
+
+        dist = ABS (dist);
+
+        if (output->preferred_mode == None || dist < best_dist)
+        {
+            output->preferred_mode = mode_info->id;
+            best_dist = dist;
         }
+    }
 
-        if (output_info->connection != RR_Connected)
+    /* read the EDID to recognize the monitor */
+    output->edid = NULL;
+    if (helper->edid_atom != None)
+    {
+        prop = NULL;
+        gdk_error_trap_push ();
+        if (XRRGetOutputProperty (helper->xdisplay, id, helper->edid_atom, 0, 128,
+                                  False, False, AnyPropertyType, &actual_type,
+                                  &actual_format, &nitems, &bytes_after, &prop) == Success
+            && actual_type == XA_INTEGER && actual_format == 8 && nitems > 0)
         {
-            XRRFreeOutputInfo (output_info);
-            continue;
+            output->edid = g_compute_checksum_for_data (G_CHECKSUM_SHA1, prop, nitems);
         }
+        if (prop != NULL)
+            XFree (prop);
+        gdk_error_trap_pop ();
+    }
 
-        output = g_new0 (XfceRROutput, 1);
-        output->id = helper->resources->outputs[n];
-        output->info = output_info;
+    /* track active outputs */
+    crtc = xfce_displays_helper_find_crtc_by_id (helper, output->info->crtc);
+    output->active = crtc && crtc->mode != None;
 
-        /* find the preferred mode */
-        output->preferred_mode = None;
-        best_dist = 0;
-        for (l = 0; l < output->info->nmode; ++l)
-        {
-            /* walk all modes */
-            for (m = 0; m < helper->resources->nmode; ++m)
-            {
-                /* does the mode info match the mode we seek? */
-                if (helper->resources->modes[m].id != output->info->modes[l])
-                    continue;
+    /* Translate output->name into xfconf compatible format in place */
+    g_strcanon(output->info->name, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_<>", '_');
 
-                if (l < output->info->npreferred)
-                    dist = 0;
-                else if (output->info->mm_height != 0)
-                    dist = (1000 * gdk_screen_height () / gdk_screen_height_mm () -
-                            1000 * helper->resources->modes[m].height / output->info->mm_height);
-                else
-                    dist = gdk_screen_height () - helper->resources->modes[m].height;
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Detected output %lu %s.", output->id,
+                    output->info->name);
 
-                dist = ABS (dist);
+    return output;
+}
 
-                if (output->preferred_mode == None || dist < best_dist)
-                {
-                    output->preferred_mode = helper->resources->modes[m].id;
-                    best_dist = dist;
-                }
-            }
-        }
 
-        /* track active outputs */
-        crtc = xfce_displays_helper_find_crtc_by_id (helper, output->info->crtc);
-        output->active = crtc && crtc->mode != None;
 
-        /* Translate output->name into xfconf compatible format in place */
-        g_strcanon(output->info->name, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_<>", '_');
+static GPtrArray *
+xfce_displays_helper_list_outputs (XfceDisplaysHelper *helper)
+{
+    GPtrArray     *outputs;
+    XfceRROutput  *output;
+    gint           n;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
 
-        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Detected output %lu %s.", output->id,
-                        output->info->name);
+    /* get all connected outputs */
+    outputs = g_ptr_array_new_with_free_func ((GDestroyNotify) xfce_displays_helper_free_output);
+    for (n = 0; n < helper->resources->noutput; ++n)
+    {
+        output = xfce_displays_helper_load_output (helper, helper->resources->outputs[n]);
 
         /* cache it */
-        g_ptr_array_add (outputs, output);
+        if (output != NULL)
+            g_ptr_array_add (outputs, output);
     }
 
     return outputs;
@@ -878,18 +1324,100 @@ xfce_displays_helper_free_output (XfceRROutput *output)
     {
         g_critical ("Failed to free output info");
     }
+    if (output->modes != NULL)
+        g_hash_table_destroy (output->modes);
+    g_free (output->edid);
     g_free (output);
 }
 
 
 
+static XfceRRCrtc *
+xfce_displays_helper_load_crtc (XfceDisplaysHelper *helper,
+                                RRCrtc              id)
+{
+    XRRCrtcInfo *crtc_info;
+    XfceRRCrtc  *crtc;
+    gint         err;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Detected CRTC %lu.", id);
+
+    gdk_error_trap_push ();
+    crtc_info = XRRGetCrtcInfo (helper->xdisplay, helper->resources, id);
+    gdk_flush ();
+    err = gdk_error_trap_pop ();
+    if (err || !crtc_info)
+    {
+        g_warning ("Failed to load info for CRTC %lu (err: %d). Skipping.",
+                   id, err);
+        return NULL;
+    }
+
+    crtc = g_new0 (XfceRRCrtc, 1);
+    crtc->id = id;
+    crtc->mode = crtc_info->mode;
+    crtc->rotation = crtc_info->rotation;
+    crtc->rotations = crtc_info->rotations;
+    crtc->width = crtc_info->width;
+    crtc->height = crtc_info->height;
+    crtc->x = crtc_info->x;
+    crtc->y = crtc_info->y;
+
+    crtc->cur_mode = crtc->mode;
+    crtc->cur_width = crtc->width;
+    crtc->cur_height = crtc->height;
+    crtc->cur_x = crtc->x;
+    crtc->cur_y = crtc->y;
+
+    crtc->noutput = crtc_info->noutput;
+    crtc->outputs = NULL;
+    if (crtc_info->noutput > 0)
+        crtc->outputs = g_memdup (crtc_info->outputs,
+                                  crtc_info->noutput * sizeof (RROutput));
+
+    crtc->npossible = crtc_info->npossible;
+    crtc->possible = NULL;
+    if (crtc_info->npossible > 0)
+        crtc->possible = g_memdup (crtc_info->possible,
+                                   crtc_info->npossible * sizeof (RROutput));
+
+    crtc->changed = FALSE;
+    XRRFreeCrtcInfo (crtc_info);
+
+    return crtc;
+}
+
+
+
+static void
+xfce_displays_helper_refresh_crtc (XfceRRCrtc         *crtc,
+                                   XfceDisplaysHelper *helper)
+{
+    XfceRRCrtc *updated;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && crtc);
+
+    updated = xfce_displays_helper_load_crtc (helper, crtc->id);
+    if (updated == NULL)
+        return;
+
+    /* update in place, the indexes and lists point to this CRTC */
+    g_free (crtc->outputs);
+    g_free (crtc->possible);
+    *crtc = *updated;
+    g_free (updated);
+}
+
+
+
 static GPtrArray *
 xfce_displays_helper_list_crtcs (XfceDisplaysHelper *helper)
 {
     GPtrArray   *crtcs;
-    XRRCrtcInfo *crtc_info;
     XfceRRCrtc  *crtc;
-    gint         n, err;
+    gint         n;
 
     g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
 
@@ -897,46 +1425,11 @@ xfce_displays_helper_list_crtcs (XfceDisplaysHelper *helper)
     crtcs = g_ptr_array_new_with_free_func ((GDestroyNotify) xfce_displays_helper_free_crtc);
     for (n = 0; n < helper->resources->ncrtc; ++n)
     {
-        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Detected CRTC %lu.", helper->resources->crtcs[n]);
-
-        gdk_error_trap_push ();
-        crtc_info = XRRGetCrtcInfo (helper->xdisplay, helper->resources, helper->resources->crtcs[n]);
-        gdk_flush ();
-        err = gdk_error_trap_pop ();
-        if (err || !crtc_info)
-        {
-            g_warning ("Failed to load info for CRTC %lu (err: %d). Skipping.",
-                       helper->resources->crtcs[n], err);
-            continue;
-        }
-
-        crtc = g_new0 (XfceRRCrtc, 1);
-        crtc->id = helper->resources->crtcs[n];
-        crtc->mode = crtc_info->mode;
-        crtc->rotation = crtc_info->rotation;
-        crtc->rotations = crtc_info->rotations;
-        crtc->width = crtc_info->width;
-        crtc->height = crtc_info->height;
-        crtc->x = crtc_info->x;
-        crtc->y = crtc_info->y;
-
-        crtc->noutput = crtc_info->noutput;
-        crtc->outputs = NULL;
-        if (crtc_info->noutput > 0)
-            crtc->outputs = g_memdup (crtc_info->outputs,
-                                      crtc_info->noutput * sizeof (RROutput));
-
-        crtc->npossible = crtc_info->npossible;
-        crtc->possible = NULL;
-        if (crtc_info->npossible > 0)
-            crtc->possible = g_memdup (crtc_info->possible,
-                                       crtc_info->npossible * sizeof (RROutput));
-
-        crtc->changed = FALSE;
-        XRRFreeCrtcInfo (crtc_info);
+        crtc = xfce_displays_helper_load_crtc (helper, helper->resources->crtcs[n]);
 
         /* cache it */
-        g_ptr_array_add (crtcs, crtc);
+        if (crtc != NULL)
+            g_ptr_array_add (crtcs, crtc);
     }
 
     return crtcs;
@@ -948,19 +1441,9 @@ static XfceRRCrtc *
 xfce_displays_helper_find_crtc_by_id (XfceDisplaysHelper *helper,
                                       RRCrtc              id)
 {
-    XfceRRCrtc *crtc;
-    guint       n;
-
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs);
-
-    for (n = 0; n < helper->crtcs->len; ++n)
-    {
-        crtc = g_ptr_array_index (helper->crtcs, n);
-        if (crtc->id == id)
-            return crtc;
-    }
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs && helper->crtc_index);
 
-    return NULL;
+    return g_hash_table_lookup (helper->crtc_index, GUINT_TO_POINTER (id));
 }
 
 
@@ -1080,40 +1563,146 @@ xfce_displays_helper_normalize_crtc (XfceRRCrtc         *crtc,
 
 static Status
 xfce_displays_helper_disable_crtc (XfceDisplaysHelper *helper,
-                                   RRCrtc              crtc)
+                                   XfceRRCrtc         *crtc)
 {
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
+    Status ret;
 
-    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Disabling CRTC %lu.", crtc);
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources && crtc);
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Disabling CRTC %lu.", crtc->id);
+
+    ret = XRRSetCrtcConfig (helper->xdisplay, helper->resources, crtc->id,
+                            CurrentTime, 0, 0, None, RR_Rotate_0, NULL, 0);
+
+    if (ret == RRSetConfigSuccess)
+    {
+        crtc->cur_mode = None;
+        crtc->cur_width = crtc->cur_height = 0;
+    }
 
-    return XRRSetCrtcConfig (helper->xdisplay, helper->resources, crtc,
-                             CurrentTime, 0, 0, None, RR_Rotate_0, NULL, 0);
+    return ret;
 }
 
 
 
-static void
-xfce_displays_helper_workaround_crtc_size (XfceRRCrtc         *crtc,
-                                           XfceDisplaysHelper *helper)
+static gboolean
+xfce_displays_helper_plan (XfceDisplaysHelper *helper,
+                           GPtrArray          *disable,
+                           GPtrArray          *configure,
+                           gboolean           *resize)
 {
-    XRRCrtcInfo *crtc_info;
+    XfceRRCrtc *crtc;
+    GHashTable *assigned;
+    gint        min_width, min_height, max_width, max_height;
+    gint        m, nenabled = 0;
+    guint       n;
+    gboolean    valid = TRUE;
 
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources && crtc);
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
+
+    /* set the screen size only if it's really needed and valid */
+    *resize = (helper->width != gdk_screen_width ()
+               || helper->height != gdk_screen_height ()
+               || helper->mm_width != gdk_screen_width_mm ()
+               || helper->mm_height != gdk_screen_height_mm ());
 
-    /* The CRTC needs to be disabled if its previous mode won't fit in the new screen.
-       It will be reenabled with its new mode (known to fit) after the screen size is
-       changed, unless the user disabled it (no need to reenable it then). */
-    crtc_info = XRRGetCrtcInfo (helper->xdisplay, helper->resources, crtc->id);
-    if ((crtc_info->x + crtc_info->width > (guint) helper->width) ||
-        (crtc_info->y + crtc_info->height > (guint) helper->height))
+    if (!XRRGetScreenSizeRange (helper->xdisplay, GDK_WINDOW_XID (helper->root_window),
+                                &min_width, &min_height, &max_width, &max_height))
     {
-        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "CRTC %lu must be temporarily disabled.", crtc->id);
-        if (xfce_displays_helper_disable_crtc (helper, crtc->id) == RRSetConfigSuccess)
-            crtc->changed = (crtc->mode != None);
-        else
-            g_warning ("Failed to temporarily disable CRTC %lu.", crtc->id);
+        g_warning ("Unable to get the range of screen sizes. "
+                   "Display settings may fail to apply.");
+        *resize = FALSE;
     }
-    XRRFreeCrtcInfo (crtc_info);
+    else if (helper->width < min_width || helper->width > max_width
+             || helper->height < min_height || helper->height > max_height)
+    {
+        g_warning ("Screen size %dx%d is outside the supported range %dx%d - %dx%d.",
+                   helper->width, helper->height, min_width, min_height,
+                   max_width, max_height);
+        return FALSE;
+    }
+
+    assigned = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    for (n = 0; n < helper->crtcs->len && valid; ++n)
+    {
+        crtc = g_ptr_array_index (helper->crtcs, n);
+
+        if (crtc->mode == None)
+        {
+            /* only disable what is enabled on the server, the
+             * change is done once the disable succeeded */
+            if (crtc->cur_mode != None)
+                g_ptr_array_add (disable, crtc);
+            else
+                crtc->changed = FALSE;
+            continue;
+        }
+
+        ++nenabled;
+
+        /* validate the configuration of the CRTC */
+        if (!g_hash_table_lookup (helper->mode_index, GUINT_TO_POINTER (crtc->mode)))
+        {
+            g_warning ("Unknown mode %lu for CRTC %lu.", crtc->mode, crtc->id);
+            valid = FALSE;
+        }
+        else if ((crtc->rotation & crtc->rotations) != crtc->rotation)
+        {
+            g_warning ("Unsupported rotation for CRTC %lu.", crtc->id);
+            valid = FALSE;
+        }
+        else if (crtc->noutput < 1)
+        {
+            g_warning ("No output for CRTC %lu.", crtc->id);
+            valid = FALSE;
+        }
+        else if (crtc->x < 0 || crtc->y < 0
+                 || crtc->x + crtc->width > helper->width
+                 || crtc->y + crtc->height > helper->height)
+        {
+            g_warning ("CRTC %lu does not fit in the screen.", crtc->id);
+            valid = FALSE;
+        }
+
+        for (m = 0; m < crtc->noutput && valid; ++m)
+        {
+            if (g_hash_table_lookup (assigned, GUINT_TO_POINTER (crtc->outputs[m])))
+            {
+                g_warning ("Output %lu is assigned to more than one CRTC.", crtc->outputs[m]);
+                valid = FALSE;
+            }
+            g_hash_table_insert (assigned, GUINT_TO_POINTER (crtc->outputs[m]), crtc);
+        }
+
+        /* The CRTC needs to be disabled if its current mode won't fit in the new screen.
+           It will be reenabled with its new mode (known to fit) after the screen size is
+           changed. */
+        if (*resize && crtc->cur_mode != None
+            && (crtc->cur_x + crtc->cur_width > helper->width
+                || crtc->cur_y + crtc->cur_height > helper->height))
+        {
+            xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "CRTC %lu must be temporarily disabled.", crtc->id);
+            g_ptr_array_add (disable, crtc);
+            crtc->changed = TRUE;
+        }
+
+        if (crtc->changed)
+            g_ptr_array_add (configure, crtc);
+    }
+
+    g_hash_table_destroy (assigned);
+
+    if (valid && nenabled == 0)
+    {
+        g_warning ("The configuration disables all CRTCs.");
+        valid = FALSE;
+    }
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Plan: %s, disable %d, resize %d, configure %d.",
+                    valid ? "valid" : "invalid", disable->len, *resize, configure->len);
+
+    return valid;
 }
 
 
@@ -1134,14 +1723,21 @@ xfce_displays_helper_apply_crtc (XfceRRCrtc         *crtc,
         xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Applying changes to CRTC %lu.", crtc->id);
 
         if (crtc->mode == None)
-            ret = xfce_displays_helper_disable_crtc (helper, crtc->id);
+            ret = xfce_displays_helper_disable_crtc (helper, crtc);
         else
             ret = XRRSetCrtcConfig (helper->xdisplay, helper->resources, crtc->id,
                                     CurrentTime, crtc->x, crtc->y, crtc->mode,
                                     crtc->rotation, crtc->outputs, crtc->noutput);
 
         if (ret == RRSetConfigSuccess)
+        {
             crtc->changed = FALSE;
+            crtc->cur_mode = crtc->mode;
+            crtc->cur_width = crtc->width;
+            crtc->cur_height = crtc->height;
+            crtc->cur_x = crtc->x;
+            crtc->cur_y = crtc->y;
+        }
         else
             g_warning ("Failed to configure CRTC %lu.", crtc->id);
     }
@@ -1185,9 +1781,15 @@ xfce_displays_helper_set_outputs (XfceRRCrtc   *crtc,
 
 
 
-static void
+static gboolean
 xfce_displays_helper_apply_all (XfceDisplaysHelper *helper)
 {
+    GPtrArray  *disable, *configure;
+    XfceRRCrtc *crtc;
+    gboolean    resize, grab;
+    gboolean    applied = FALSE;
+    guint       n;
+
     g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs);
 
     helper->mm_width = helper->mm_height = helper->width = helper->height = 0;
@@ -1197,19 +1799,44 @@ xfce_displays_helper_apply_all (XfceDisplaysHelper *helper)
     g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_get_topleftmost_pos, helper);
     g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_normalize_crtc, helper);
 
+    /* compute and validate the transition before touching the server */
+    disable = g_ptr_array_new ();
+    configure = g_ptr_array_new ();
+    if (!xfce_displays_helper_plan (helper, disable, configure, &resize))
+    {
+        g_critical ("Invalid display configuration, not applied.");
+
+        /* the CRTCs were changed for the rejected configuration, bring
+         * them back in line with the server for the next apply */
+        g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_refresh_crtc, helper);
+        goto cleanup;
+    }
+
     gdk_error_trap_push ();
 
+    /* no need to freeze the clients if the layout doesn't change */
+    grab = disable->len > 0 || configure->len > 0 || resize;
+
     /* grab server to prevent clients from thinking no output is enabled */
-    gdk_x11_display_grab (helper->display);
+    if (grab)
+        gdk_x11_display_grab (helper->display);
 
-    /* disable CRTCs that won't fit in the new screen */
-    g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_workaround_crtc_size, helper);
+    /* disable CRTCs that are turned off or won't fit in the new screen */
+    for (n = 0; n < disable->len; ++n)
+    {
+        crtc = g_ptr_array_index (disable, n);
+        if (xfce_displays_helper_disable_crtc (helper, crtc) != RRSetConfigSuccess)
+            g_warning ("Failed to disable CRTC %lu.", crtc->id);
+        else if (crtc->mode == None)
+            crtc->changed = FALSE;
+    }
 
-    /* set the screen size only if it's really needed and valid */
-    xfce_displays_helper_set_screen_size (helper);
+    /* set the screen size once */
+    if (resize)
+        xfce_displays_helper_set_screen_size (helper);
 
     /* final loop, apply crtc changes */
-    g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_apply_crtc, helper);
+    g_ptr_array_foreach (configure, (GFunc) xfce_displays_helper_apply_crtc, helper);
 
 #ifdef HAS_RANDR_ONE_POINT_THREE
         if (helper->has_1_3)
@@ -1218,32 +1845,39 @@ xfce_displays_helper_apply_all (XfceDisplaysHelper *helper)
 #endif
 
     /* release the grab, changes are done */
-    gdk_x11_display_ungrab (helper->display);
+    if (grab)
+        gdk_x11_display_ungrab (helper->display);
     gdk_flush ();
     if (gdk_error_trap_pop () != 0)
     {
         g_critical ("Failed to apply display settings");
     }
+    else
+        applied = TRUE;
+
+cleanup:
+    g_ptr_array_free (disable, TRUE);
+    g_ptr_array_free (configure, TRUE);
+
+    return applied;
 }
 
 
 
-static void
-xfce_displays_helper_channel_apply (XfceDisplaysHelper *helper,
-                                    const gchar        *scheme)
+static gboolean
+xfce_displays_helper_channel_load (XfceDisplaysHelper *helper,
+                                   const gchar        *scheme)
 {
-    gchar       property[512];
     guint       n, nactive;
     GHashTable *saved_outputs;
+    gboolean    loaded = FALSE;
 
-    saved_outputs = NULL;
 #ifdef HAS_RANDR_ONE_POINT_THREE
     helper->primary = None;
 #endif
 
     /* finally the list of saved outputs from xfconf */
-    g_snprintf (property, sizeof (property), "/%s", scheme);
-    saved_outputs = xfconf_channel_get_properties (helper->channel, property);
+    saved_outputs = xfce_displays_helper_parse_scheme (helper, scheme);
 
     /* nothing saved, nothing to do */
     if (saved_outputs == NULL)
@@ -1253,7 +1887,7 @@ xfce_displays_helper_channel_apply (XfceDisplaysHelper *helper,
     nactive = 0;
     for (n = 0; n < helper->outputs->len; ++n)
     {
-        if (xfce_displays_helper_load_from_xfconf (helper, scheme, saved_outputs,
+        if (xfce_displays_helper_load_from_xfconf (helper, saved_outputs,
                                                    g_ptr_array_index (helper->outputs,
                                                                       n)))
             ++nactive;
@@ -1268,13 +1902,229 @@ xfce_displays_helper_channel_apply (XfceDisplaysHelper *helper,
         goto err_cleanup;
     }
 
-    /* apply settings */
-    xfce_displays_helper_apply_all (helper);
+    loaded = TRUE;
 
 err_cleanup:
     /* Free the xfconf properties */
     if (saved_outputs)
         g_hash_table_destroy (saved_outputs);
+
+    return loaded;
+}
+
+
+
+static gboolean
+xfce_displays_helper_channel_apply (XfceDisplaysHelper *helper,
+                                    const gchar        *scheme)
+{
+    if (!xfce_displays_helper_channel_load (helper, scheme))
+        return FALSE;
+
+    /* apply settings */
+    return xfce_displays_helper_apply_all (helper);
+}
+
+
+
+static gchar *
+xfce_displays_helper_join_fingerprint (GPtrArray *items)
+{
+    gchar *fingerprint;
+
+    /* independent of the order of the outputs */
+    g_ptr_array_sort (items, (GCompareFunc) g_strcmp0);
+    g_ptr_array_add (items, NULL);
+    fingerprint = g_strjoinv (",", (gchar **) items->pdata);
+    g_ptr_array_remove_index (items, items->len - 1);
+
+    return fingerprint;
+}
+
+
+
+static gchar *
+xfce_displays_helper_fingerprint (XfceDisplaysHelper *helper)
+{
+    GPtrArray    *items;
+    XfceRROutput *output;
+    gchar        *fingerprint = NULL;
+    guint         n;
+
+    items = g_ptr_array_new_with_free_func (g_free);
+
+    for (n = 0; n < helper->outputs->len; ++n)
+    {
+        output = g_ptr_array_index (helper->outputs, n);
+
+        /* only monitors we can recognize */
+        if (output->edid == NULL)
+            goto cleanup;
+
+        g_ptr_array_add (items, g_strdup_printf ("%s:%s", output->info->name, output->edid));
+    }
+
+    if (items->len > 0)
+        fingerprint = xfce_displays_helper_join_fingerprint (items);
+
+cleanup:
+    g_ptr_array_unref (items);
+
+    return fingerprint;
+}
+
+
+
+static void
+xfce_displays_helper_index_fingerprints (XfceDisplaysHelper *helper)
+{
+    GHashTable     *properties, *schemes;
+    GHashTableIter  iter;
+    GPtrArray      *items;
+    GValue         *value;
+    gpointer        key;
+    const gchar    *property, *output, *field, *existing;
+    gchar          *scheme, *fingerprint;
+
+    helper->fingerprints = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+    properties = xfconf_channel_get_properties (helper->channel, NULL);
+    if (properties == NULL)
+        return;
+
+    /* collect /<scheme>/<output>/EDID per scheme */
+    schemes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                     (GDestroyNotify) g_ptr_array_unref);
+    g_hash_table_iter_init (&iter, properties);
+    while (g_hash_table_iter_next (&iter, &key, (gpointer *) &value))
+    {
+        property = key;
+        if (*property != '/' || !G_VALUE_HOLDS_STRING (value)
+            || (output = strchr (property + 1, '/')) == NULL
+            || (field = strchr (output + 1, '/')) == NULL
+            || strcmp (field, EDID_PROP) != 0)
+            continue;
+
+        scheme = g_strndup (property + 1, output - property - 1);
+        items = g_hash_table_lookup (schemes, scheme);
+        if (items == NULL)
+        {
+            items = g_ptr_array_new_with_free_func (g_free);
+            g_hash_table_insert (schemes, scheme, items);
+        }
+        else
+            g_free (scheme);
+
+        g_ptr_array_add (items, g_strdup_printf ("%.*s:%s", (gint) (field - output - 1),
+                                                 output + 1, g_value_get_string (value)));
+    }
+
+    g_hash_table_iter_init (&iter, schemes);
+    while (g_hash_table_iter_next (&iter, &key, (gpointer *) &items))
+    {
+        fingerprint = xfce_displays_helper_join_fingerprint (items);
+
+        /* prefer a named scheme over the default one */
+        existing = g_hash_table_lookup (helper->fingerprints, fingerprint);
+        if (existing == NULL || strcmp (existing, DEFAULT_SCHEME_NAME) == 0)
+            g_hash_table_replace (helper->fingerprints, fingerprint, g_strdup (key));
+        else
+            g_free (fingerprint);
+    }
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Indexed %d scheme fingerprint(s).",
+                    g_hash_table_size (helper->fingerprints));
+
+    g_hash_table_destroy (schemes);
+    g_hash_table_destroy (properties);
+}
+
+
+
+static const gchar *
+xfce_displays_helper_find_scheme (XfceDisplaysHelper *helper)
+{
+    const gchar *scheme = NULL;
+    gchar       *fingerprint;
+
+    fingerprint = xfce_displays_helper_fingerprint (helper);
+    if (fingerprint == NULL)
+        return NULL;
+
+    if (helper->fingerprints == NULL)
+        xfce_displays_helper_index_fingerprints (helper);
+
+    scheme = g_hash_table_lookup (helper->fingerprints, fingerprint);
+    g_free (fingerprint);
+
+    return scheme;
+}
+
+
+
+static void
+xfce_displays_helper_store_fingerprint (XfceDisplaysHelper *helper,
+                                        const gchar        *scheme)
+{
+    GHashTable     *properties;
+    GHashTableIter  iter;
+    XfceRROutput   *output;
+    gpointer        key;
+    GValue         *value;
+    const gchar    *name, *field;
+    gchar          *prefix, *property, *stored;
+    gsize           prefix_len;
+    guint           n;
+
+    /* remember the monitors this scheme was applied on */
+    for (n = 0; n < helper->outputs->len; ++n)
+    {
+        output = g_ptr_array_index (helper->outputs, n);
+        if (output->edid == NULL)
+            continue;
+
+        property = g_strdup_printf ("/%s/%s", scheme, output->info->name);
+        if (xfconf_channel_has_property (helper->channel, property))
+        {
+            g_free (property);
+            property = g_strdup_printf ("/%s/%s" EDID_PROP, scheme, output->info->name);
+            stored = xfconf_channel_get_string (helper->channel, property, NULL);
+            if (g_strcmp0 (stored, output->edid) != 0)
+                xfconf_channel_set_string (helper->channel, property, output->edid);
+            g_free (stored);
+        }
+        g_free (property);
+    }
+
+    /* and forget the ones that are not connected anymore */
+    prefix = g_strdup_printf ("/%s/", scheme);
+    prefix_len = strlen (prefix);
+    properties = xfconf_channel_get_properties (helper->channel, prefix);
+    if (properties != NULL)
+    {
+        g_hash_table_iter_init (&iter, properties);
+        while (g_hash_table_iter_next (&iter, &key, (gpointer *) &value))
+        {
+            name = (const gchar *) key + prefix_len;
+            field = strchr (name, '/');
+            if (field == NULL || strcmp (field, EDID_PROP) != 0)
+                continue;
+
+            property = g_strndup (name, field - name);
+            for (n = 0; n < helper->outputs->len; ++n)
+            {
+                output = g_ptr_array_index (helper->outputs, n);
+                if (output->edid != NULL && strcmp (output->info->name, property) == 0)
+                    break;
+            }
+            g_free (property);
+
+            if (n == helper->outputs->len)
+                xfconf_channel_reset_property (helper->channel, key, FALSE);
+        }
+        g_hash_table_destroy (properties);
+    }
+    g_free (prefix);
 }
 
 
@@ -1288,26 +2138,59 @@ xfce_displays_helper_channel_property_changed (XfconfChannel      *channel,
     if (G_UNLIKELY (G_VALUE_HOLDS_STRING (value) &&
         g_strcmp0 (property_name, APPLY_SCHEME_PROP) == 0))
     {
-        /* apply */
-        xfce_displays_helper_channel_apply (helper, g_value_get_string (value));
+        /* apply and remember the monitors of the scheme */
+        if (xfce_displays_helper_channel_apply (helper, g_value_get_string (value)))
+            xfce_displays_helper_store_fingerprint (helper, g_value_get_string (value));
         /* remove the apply property */
         xfconf_channel_reset_property (channel, APPLY_SCHEME_PROP, FALSE);
     }
+    else if (g_str_has_suffix (property_name, EDID_PROP))
+    {
+        /* rebuild the fingerprints on the next hotplug */
+        if (helper->fingerprints != NULL)
+        {
+            g_hash_table_destroy (helper->fingerprints);
+            helper->fingerprints = NULL;
+        }
+    }
+    else if (g_strcmp0 (property_name, SETTLE_PROP) == 0)
+    {
+        if (G_VALUE_HOLDS_INT (value))
+            helper->settle_ms = CLAMP (g_value_get_int (value), 0, SETTLE_MAX_MS);
+        else
+            helper->settle_ms = SETTLE_DEFAULT_MS;
+    }
 }
 
 
 
+#ifdef HAVE_UPOWERGLIB
 static void
-xfce_displays_helper_toggle_internal (gpointer           *power,
-                                      gboolean            lid_is_closed,
-                                      XfceDisplaysHelper *helper)
+xfce_displays_helper_lid_changed (XfceDisplaysUPower *power,
+                                  gboolean            lid_is_closed,
+                                  XfceDisplaysHelper *helper)
+{
+    /* a dock usually changes the outputs at the same time, so handle
+     * the lid together with the hotplug events */
+    helper->lid_is_closed = lid_is_closed;
+    helper->pending_lid = TRUE;
+
+    xfce_displays_helper_queue_settle (helper);
+}
+#endif
+
+
+
+static gboolean
+xfce_displays_helper_toggle_internal (XfceDisplaysHelper *helper,
+                                      gboolean            lid_is_closed)
 {
     GHashTable    *saved_outputs;
     XfceRRCrtc    *crtc = NULL;
     XfceRROutput  *output, *lvds = NULL;
+    XRRModeInfo   *mode_info;
     gboolean       active = FALSE;
     guint          n;
-    gint           m;
 
     for (n = 0; n < helper->outputs->len; ++n)
     {
@@ -1324,7 +2207,7 @@ xfce_displays_helper_toggle_internal (gpointer           *power,
     }
 
     if (!lvds)
-        return;
+        return FALSE;
 
     xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Toggling internal output %s.",
                     lvds->info->name);
@@ -1334,7 +2217,7 @@ xfce_displays_helper_toggle_internal (gpointer           *power,
         /* if active and the lid is closed, deactivate it */
         crtc = xfce_displays_helper_find_usable_crtc (helper, lvds);
         if (!crtc)
-            return;
+            return FALSE;
         crtc->mode = None;
         crtc->noutput = 0;
         crtc->changed = TRUE;
@@ -1343,7 +2226,7 @@ xfce_displays_helper_toggle_internal (gpointer           *power,
     else if (!lvds->active && !lid_is_closed)
     {
         /* re-activate it because the user opened the lid */
-        saved_outputs = xfconf_channel_get_properties (helper->channel, "/" DEFAULT_SCHEME_NAME);
+        saved_outputs = xfce_displays_helper_parse_scheme (helper, DEFAULT_SCHEME_NAME);
         if (saved_outputs)
         {
             /* first, ensure the position of the other outputs is correct */
@@ -1355,13 +2238,11 @@ xfce_displays_helper_toggle_internal (gpointer           *power,
                 if (output->id == lvds->id)
                     continue;
 
-                xfce_displays_helper_load_from_xfconf (helper, DEFAULT_SCHEME_NAME,
-                                                       saved_outputs, output);
+                xfce_displays_helper_load_from_xfconf (helper, saved_outputs, output);
             }
 
             /* try to load user saved settings for lvds */
-            active = xfce_displays_helper_load_from_xfconf (helper, DEFAULT_SCHEME_NAME,
-                                                            saved_outputs, lvds);
+            active = xfce_displays_helper_load_from_xfconf (helper, saved_outputs, lvds);
             g_hash_table_destroy (saved_outputs);
         }
         if (!active)
@@ -1369,19 +2250,17 @@ xfce_displays_helper_toggle_internal (gpointer           *power,
             /* autoset the preferred mode */
             crtc = xfce_displays_helper_find_usable_crtc (helper, lvds);
             if (!crtc)
-                return;
+                return FALSE;
             crtc->mode = lvds->preferred_mode;
             crtc->rotation = RR_Rotate_0;
             crtc->x = crtc->y = 0;
             /* set width and height */
-            for (m = 0; m < helper->resources->nmode; ++m)
+            mode_info = g_hash_table_lookup (helper->mode_index,
+                                             GUINT_TO_POINTER (lvds->preferred_mode));
+            if (mode_info != NULL)
             {
-                if (helper->resources->modes[m].id == lvds->preferred_mode)
-                {
-                    crtc->width = helper->resources->modes[m].width;
-                    crtc->height = helper->resources->modes[m].height;
-                    break;
-                }
+                crtc->width = mode_info->width;
+                crtc->height = mode_info->height;
             }
             xfce_displays_helper_set_outputs (crtc, lvds);
             crtc->changed = TRUE;
@@ -1390,8 +2269,8 @@ xfce_displays_helper_toggle_internal (gpointer           *power,
                         lvds->info->name);
     }
     else
-        return;
+        return FALSE;
 
-    /* apply settings */
-    xfce_displays_helper_apply_all (helper);
+    /* the caller applies the settings */
+    return TRUE;
 }
@@ -34,8 +34,11 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <signal.h>
 #include <glib.h>
+#include <dbus/dbus.h>
 #include <xfconf/xfconf.h>
 #include <garcon/garcon.h>
 #include <libxfce4ui/libxfce4ui.h>
@@ -60,6 +63,20 @@
 #define XFCE_FIREJAIL_BANDWIDTH_UPLOAD_DEFAULT   200000
 #endif
 
+/* How long to wait for a new sandbox to write its environment file, and for
+ * a write in progress to finish when the file already exists on discovery */
+#define XFCE_SANDBOX_PENDING_TIMEOUT_SEC 10
+#define XFCE_SANDBOX_PENDING_SETTLE_MS   250
+
+/* Number of threads reading the environment of existing sandboxes on startup */
+#define XFCE_SANDBOX_SCAN_THREADS 4
+
+/* How often failed bandwidth updates are retried, how many are re-applied at once,
+ * and the longest delay between retries of a limit firejail keeps failing to apply */
+#define XFCE_SANDBOX_RECONCILE_INTERVAL_SEC 30
+#define XFCE_SANDBOX_RECONCILE_BATCH        4
+#define XFCE_SANDBOX_BACKOFF_MAX_SEC        600
+
 /* Type of Xfce sandbox being treated (guessed from environment) */
 typedef enum {
     XFCE_SANDBOX_UNKNOWN = 0,
@@ -68,25 +85,134 @@ typedef enum {
 } XfceSandboxType;
 
 typedef struct _XfceSandboxProcess {
-    pid_t            pid;
-    gchar           *name;
-    XfceSandboxType  type;
-    guint            ws_number;
-    gchar           *desktop_path;
+    XfceSandboxPoller *poller;
+    pid_t              pid;
+    gchar             *name;
+    XfceSandboxType    type;
+    guint              ws_number;
+    gchar             *desktop_path;
 } XfceSandboxProcess;
 
+/* Sandbox whose runtime directory exists, but whose environment file is not written yet */
+typedef struct _XfceSandboxPending {
+    XfceSandboxPoller *poller;
+    pid_t              pid;
+    GFileMonitor      *monitor;
+    guint              timeout_id;
+    guint              settle_id;
+    guint              attempts;
+    gint64             created;
+} XfceSandboxPending;
+
+/* Counters exported over D-Bus */
+typedef enum {
+    XFCE_SANDBOX_COUNTER_ADDED = 0,
+    XFCE_SANDBOX_COUNTER_ENV_ATTEMPTS,
+    XFCE_SANDBOX_COUNTER_ENV_TIMEOUTS,
+    XFCE_SANDBOX_COUNTER_LOOKUP_FAILURES,
+    XFCE_SANDBOX_COUNTER_BANDWIDTH_UPDATES,
+    XFCE_SANDBOX_COUNTER_BANDWIDTH_MERGED,
+    XFCE_SANDBOX_COUNTER_SPAWN_FAILURES,
+    XFCE_SANDBOX_COUNTER_FIREJAIL_FAILURES,
+    XFCE_SANDBOX_COUNTER_RECONCILED,
+    XFCE_SANDBOX_N_COUNTERS
+} XfceSandboxCounter;
+
+static const gchar *counter_names[XFCE_SANDBOX_N_COUNTERS] =
+{
+    "sandboxes_added",
+    "env_attempts",
+    "env_timeouts",
+    "desktop_lookup_failures",
+    "bandwidth_updates",
+    "bandwidth_merged",
+    "spawn_failures",
+    "firejail_failures",
+    "bandwidth_reconciled"
+};
+
+/* Latency histograms exported over D-Bus, all in microseconds */
+typedef enum {
+    XFCE_SANDBOX_HISTOGRAM_DETECTION = 0,
+    XFCE_SANDBOX_HISTOGRAM_ENV_PARSE,
+    XFCE_SANDBOX_HISTOGRAM_SPAWN,
+    XFCE_SANDBOX_HISTOGRAM_ENFORCEMENT,
+    XFCE_SANDBOX_N_HISTOGRAMS
+} XfceSandboxHistogramId;
+
+static const gchar *histogram_names[XFCE_SANDBOX_N_HISTOGRAMS] =
+{
+    "detection_delay_us",
+    "env_parse_us",
+    "spawn_us",
+    "enforcement_us"
+};
+
+static const guint64 histogram_bounds[] =
+{
+    100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000
+};
+
+typedef struct _XfceSandboxHistogram {
+    guint64            count;
+    guint64            sum;
+    guint64            buckets[G_N_ELEMENTS (histogram_bounds) + 1];
+} XfceSandboxHistogram;
+
+/* Result of reading the environment of an existing sandbox in the scan pool */
+typedef struct _XfceSandboxScan {
+    XfceSandboxPoller *poller;
+    guint              serial;
+    pid_t              pid;
+    gboolean           exited;
+    XfceSandboxType    type;
+    gchar             *name;
+    gint64             parse_time;
+} XfceSandboxScan;
+
+/* Bandwidth limits waiting to be handed over to firejail */
+typedef struct _XfceSandboxBandwidth {
+    gchar             *name;
+    gint               download;
+    gint               upload;
+    gint64             queued;
+} XfceSandboxBandwidth;
+
+/* Sandbox settings of a .desktop file, and the file they were parsed from */
+typedef struct _XfceSandboxDesktopPolicy {
+    dev_t              dev;
+    ino_t              ino;
+    time_t             mtime;
+    off_t              size;
+    gboolean           network;
+    gint               download;
+    gint               upload;
+} XfceSandboxDesktopPolicy;
+
+/* Desired and last applied bandwidth limits of a firejail name */
+typedef struct _XfceSandboxBandwidthState {
+    gint               want_download;
+    gint               want_upload;
+    gint               have_download;
+    gint               have_upload;
+    gboolean           applied;
+    guint              failures;
+    gint64             retry_after;
+} XfceSandboxBandwidthState;
+
 
 
 static void                 xfce_sandbox_poller_dispose                   (GObject                *object);
 static void                 xfce_sandbox_poller_finalize                  (GObject                *object);
 static gboolean             xfce_sandbox_poller_initial_load              (XfceSandboxPoller      *poller,
                                                                            GError                **error);
+static void                 xfce_sandbox_poller_add_process               (XfceSandboxPoller      *poller,
+                                                                           pid_t                   pid,
+                                                                           XfceSandboxType         type,
+                                                                           const gchar            *name);
 static gboolean             xfce_sandbox_poller_add_entry_from_pid        (XfceSandboxPoller      *poller,
                                                                            pid_t                   pid,
                                                                            gboolean               *retry);
-static gboolean             xfce_sandbox_poller_add_entry                 (XfceSandboxPoller      *poller,
-                                                                           const gchar            *name,
-                                                                           gboolean               *retry);
 static gboolean             xfce_sandbox_poller_remove_entry_from_pid     (XfceSandboxPoller      *poller,
                                                                            pid_t                   pid);
 static gboolean             xfce_sandbox_poller_remove_entry              (XfceSandboxPoller      *poller,
@@ -101,6 +227,9 @@ static void                 xfce_sandbox_poller_on_desktop_changed        (GFile
                                                                            GFile                  *other_file,
                                                                            GFileMonitorEvent       event_type,
                                                                            gpointer                user_data);
+static void                 xfce_sandbox_poller_watch_entry               (XfceSandboxPoller      *poller,
+                                                                           const gchar            *name);
+static void                 xfce_sandbox_pending_free                     (XfceSandboxPending     *pending);
 static void                 xfce_sandbox_poller_reload                    (XfceSandboxPoller      *poller);
 static void                 xfce_sandbox_poller_unload                    (XfceSandboxPoller      *poller);
 static void                 xfce_sandbox_poller_channel_property_changed  (XfconfChannel          *channel,
@@ -108,7 +237,17 @@ static void                 xfce_sandbox_poller_channel_property_changed  (Xfcon
                                                                            const GValue           *value,
                                                                            XfceSandboxPoller      *helper);
 
-static XfceSandboxProcess*  xfce_sandbox_process_new                      (pid_t                   pid,
+static gchar**              xfce_sandbox_poller_build_envp                (void);
+static void                 xfce_sandbox_bandwidth_free                   (XfceSandboxBandwidth   *bw);
+static void                 xfce_sandbox_poller_set_bandwidth             (XfceSandboxPoller      *poller,
+                                                                           const gchar            *name,
+                                                                           gint                    download,
+                                                                           gint                    upload);
+static void                 xfce_sandbox_poller_run_bandwidth             (XfceSandboxPoller      *poller);
+static gboolean             xfce_sandbox_poller_reconcile                 (gpointer                user_data);
+
+static XfceSandboxProcess*  xfce_sandbox_process_new                      (XfceSandboxPoller      *poller,
+                                                                           pid_t                   pid,
                                                                            const gchar            *name,
                                                                            XfceSandboxType         type);
 static void                 xfce_sandbox_process_free                     (XfceSandboxProcess     *proc);
@@ -117,6 +256,13 @@ static gboolean             xfce_sandbox_process_apply_workspace_prop     (XfceS
 static gboolean             xfce_sandbox_process_apply_desktop_props      (XfceSandboxProcess     *proc);
 static gboolean             xfce_sandbox_process_start_watching           (XfceSandboxProcess     *proc);
 
+static void                 xfce_sandbox_poller_index_process             (XfceSandboxPoller      *poller,
+                                                                           XfceSandboxProcess     *proc);
+static void                 xfce_sandbox_poller_unindex_process           (XfceSandboxPoller      *poller,
+                                                                           XfceSandboxProcess     *proc);
+static gchar*               find_desktop_path_from_name                   (XfceSandboxPoller      *poller,
+                                                                           const gchar            *name);
+
 
 
 struct _XfceSandboxPollerClass
@@ -130,11 +276,47 @@ struct _XfceSandboxPoller
 
     const gchar        *rundir_path;
     GHashTable         *sandboxes;
+    GHashTable         *pending;
     XfconfChannel      *channel;
+
+    /* initial scan of existing sandboxes */
+    GThreadPool        *scan_pool;
+    GAsyncQueue        *scan_results;
+    guint               scan_serial;
+
     GFileMonitor       *monitor;
     GFileMonitor       *app_monitor;
     GFileMonitor       *local_app_monitor;
     GFileMonitor       *home_app_monitor;
+
+    /* app name -> .desktop path, and .desktop path -> app name */
+    GHashTable         *desktop_index;
+    GHashTable         *desktop_paths;
+    gboolean            desktop_index_valid;
+
+    /* .desktop path -> XfceSandboxDesktopPolicy */
+    GHashTable         *desktop_policies;
+
+    /* sandbox name -> GSList of pids, workspace id -> GSList of pids */
+    GHashTable         *names;
+    GHashTable         *workspaces;
+
+    /* bandwidth updates, applied by one firejail process at a time */
+    GQueue             *bw_queue;
+    GHashTable         *bw_queued;
+    gchar             **bw_envp;
+    GPid                bw_pid;
+    guint               bw_watch_id;
+    gint64              bw_started;
+    XfceSandboxBandwidth *bw_running;
+    GHashTable         *bw_state;
+    guint               reconcile_id;
+
+    /* metrics */
+    DBusConnection     *dbus_connection;
+    guint64             counters[XFCE_SANDBOX_N_COUNTERS];
+    XfceSandboxHistogram histograms[XFCE_SANDBOX_N_HISTOGRAMS];
+
     guint               handler;
 };
 
@@ -143,6 +325,138 @@ G_DEFINE_TYPE (XfceSandboxPoller, xfce_sandbox_poller, G_TYPE_OBJECT);
 
 
 
+static gint64
+xfce_sandbox_now (void)
+{
+#if GLIB_CHECK_VERSION (2, 28, 0)
+    return g_get_monotonic_time ();
+#else
+    GTimeVal now;
+
+    g_get_current_time (&now);
+    return (gint64) now.tv_sec * G_USEC_PER_SEC + now.tv_usec;
+#endif
+}
+
+
+
+static void
+xfce_sandbox_poller_count (XfceSandboxPoller  *poller,
+                           XfceSandboxCounter  counter,
+                           guint64             n)
+{
+    poller->counters[counter] += n;
+}
+
+
+
+static void
+xfce_sandbox_poller_record (XfceSandboxPoller      *poller,
+                            XfceSandboxHistogramId  id,
+                            gint64                  usec)
+{
+    XfceSandboxHistogram *histogram = &poller->histograms[id];
+    guint                 i;
+
+    if (usec < 0)
+      usec = 0;
+
+    for (i = 0; i < G_N_ELEMENTS (histogram_bounds) && (guint64) usec > histogram_bounds[i]; i++);
+
+    histogram->count++;
+    histogram->sum += usec;
+    histogram->buckets[i]++;
+}
+
+
+
+static void
+xfce_sandbox_poller_dbus_append (DBusMessageIter *dict,
+                                 const gchar     *key,
+                                 guint64          value)
+{
+    DBusMessageIter entry;
+    dbus_uint64_t   v = value;
+
+    dbus_message_iter_open_container (dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+    dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_append_basic (&entry, DBUS_TYPE_UINT64, &v);
+    dbus_message_iter_close_container (dict, &entry);
+}
+
+
+
+static DBusHandlerResult
+xfce_sandbox_poller_dbus_message (DBusConnection *connection,
+                                  DBusMessage    *message,
+                                  void           *user_data)
+{
+    XfceSandboxPoller    *poller = XFCE_SANDBOX_POLLER (user_data);
+    XfceSandboxHistogram *histogram;
+    DBusMessage          *reply;
+    DBusMessageIter       iter, dict;
+    gchar                *key;
+    guint                 i, j;
+    guint64               cumulative;
+
+    if (!dbus_message_is_method_call (message, XFCE_SANDBOX_POLLER_DBUS_INTERFACE, "GetMetrics"))
+      return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    reply = dbus_message_new_method_return (message);
+    if (reply == NULL)
+      return DBUS_HANDLER_RESULT_NEED_MEMORY;
+
+    dbus_message_iter_init_append (reply, &iter);
+    dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "{st}", &dict);
+
+    for (i = 0; i < XFCE_SANDBOX_N_COUNTERS; i++)
+      xfce_sandbox_poller_dbus_append (&dict, counter_names[i], poller->counters[i]);
+
+    /* histograms are exported as cumulative buckets, plus their count and sum */
+    for (i = 0; i < XFCE_SANDBOX_N_HISTOGRAMS; i++)
+    {
+      histogram = &poller->histograms[i];
+
+      for (j = 0, cumulative = 0; j < G_N_ELEMENTS (histogram_bounds); j++)
+      {
+        cumulative += histogram->buckets[j];
+        key = g_strdup_printf ("%s_le_%" G_GUINT64_FORMAT, histogram_names[i], histogram_bounds[j]);
+        xfce_sandbox_poller_dbus_append (&dict, key, cumulative);
+        g_free (key);
+      }
+
+      key = g_strdup_printf ("%s_le_inf", histogram_names[i]);
+      xfce_sandbox_poller_dbus_append (&dict, key, histogram->count);
+      g_free (key);
+
+      key = g_strdup_printf ("%s_count", histogram_names[i]);
+      xfce_sandbox_poller_dbus_append (&dict, key, histogram->count);
+      g_free (key);
+
+      key = g_strdup_printf ("%s_sum", histogram_names[i]);
+      xfce_sandbox_poller_dbus_append (&dict, key, histogram->sum);
+      g_free (key);
+    }
+
+    dbus_message_iter_close_container (&iter, &dict);
+
+    dbus_connection_send (connection, reply, NULL);
+    dbus_message_unref (reply);
+
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+
+static const DBusObjectPathVTable xfce_sandbox_poller_dbus_vtable =
+{
+    NULL,
+    xfce_sandbox_poller_dbus_message,
+    NULL, NULL, NULL, NULL
+};
+
+
+
 static void
 xfce_sandbox_poller_class_init (XfceSandboxPollerClass *klass)
 {
@@ -161,8 +475,40 @@ xfce_sandbox_poller_init (XfceSandboxPoller *poller)
 
     poller->rundir_path = EXECHELP_RUN_DIR;
     poller->sandboxes   = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) xfce_sandbox_process_free);
+    poller->pending     = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) xfce_sandbox_pending_free);
     poller->channel = xfconf_channel_get ("xfwm4");
 
+    poller->scan_pool    = NULL;
+    poller->scan_results = g_async_queue_new ();
+    poller->scan_serial  = 0;
+
+    poller->desktop_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    poller->desktop_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    poller->desktop_index_valid = FALSE;
+    poller->desktop_policies = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    poller->names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    poller->workspaces = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    poller->bw_queue    = g_queue_new ();
+    poller->bw_queued   = g_hash_table_new (g_str_hash, g_str_equal);
+    poller->bw_envp     = xfce_sandbox_poller_build_envp ();
+    poller->bw_pid      = 0;
+    poller->bw_watch_id = 0;
+    poller->bw_running  = NULL;
+    poller->bw_state    = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    poller->reconcile_id = 0;
+
+    /* export the metrics on the connection that owns our bus name */
+    poller->dbus_connection = dbus_bus_get (DBUS_BUS_SESSION, NULL);
+    if (poller->dbus_connection != NULL
+        && !dbus_connection_register_object_path (poller->dbus_connection, XFCE_SANDBOX_POLLER_DBUS_PATH,
+                                                  &xfce_sandbox_poller_dbus_vtable, poller))
+    {
+        g_warning ("Failed to export the sandbox poller metrics on D-Bus.\n");
+        dbus_connection_unref (poller->dbus_connection);
+        poller->dbus_connection = NULL;
+    }
+
     /* monitor channel changes */
     poller->handler = g_signal_connect (G_OBJECT (poller->channel),
                                         "property-changed",
@@ -193,8 +539,29 @@ xfce_sandbox_poller_dispose (GObject *object)
     g_signal_handlers_disconnect_by_func (poller->local_app_monitor, xfce_sandbox_poller_on_desktop_changed, poller);
     g_signal_handlers_disconnect_by_func (poller->home_app_monitor, xfce_sandbox_poller_on_desktop_changed, poller);
 
+    g_hash_table_remove_all (poller->pending);
     xfce_sandbox_poller_unload (poller);
 
+    if (poller->reconcile_id)
+    {
+        g_source_remove (poller->reconcile_id);
+        poller->reconcile_id = 0;
+    }
+
+    /* drop updates that were not started yet; the child watch of the running
+     * one holds its own reference, so firejail is still reaped when it exits */
+    g_hash_table_remove_all (poller->bw_state);
+    g_hash_table_remove_all (poller->bw_queued);
+    g_queue_foreach (poller->bw_queue, (GFunc) xfce_sandbox_bandwidth_free, NULL);
+    g_queue_clear (poller->bw_queue);
+
+    if (poller->dbus_connection != NULL)
+    {
+        dbus_connection_unregister_object_path (poller->dbus_connection, XFCE_SANDBOX_POLLER_DBUS_PATH);
+        dbus_connection_unref (poller->dbus_connection);
+        poller->dbus_connection = NULL;
+    }
+
     (*G_OBJECT_CLASS (xfce_sandbox_poller_parent_class)->dispose) (object);
     xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Finished disposing of the sandbox poller.");
 }
@@ -208,14 +575,27 @@ xfce_sandbox_poller_finalize (GObject *object)
     xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Finalizing the sandbox poller.");
 
     g_hash_table_destroy (poller->sandboxes);
+    g_hash_table_destroy (poller->pending);
+    g_hash_table_destroy (poller->names);
+    g_hash_table_destroy (poller->workspaces);
+    g_hash_table_destroy (poller->desktop_index);
+    g_hash_table_destroy (poller->desktop_paths);
+    g_hash_table_destroy (poller->desktop_policies);
     g_object_unref (poller->channel);
+
+    if (poller->scan_pool != NULL)
+      g_thread_pool_free (poller->scan_pool, TRUE, TRUE);
+    g_async_queue_unref (poller->scan_results);
     
     g_object_unref (poller->monitor);
     g_object_unref (poller->app_monitor);
     g_object_unref (poller->local_app_monitor);
     g_object_unref (poller->home_app_monitor);
 
-    g_hash_table_destroy (poller->sandboxes);
+    g_queue_free (poller->bw_queue);
+    g_hash_table_destroy (poller->bw_queued);
+    g_hash_table_destroy (poller->bw_state);
+    g_strfreev (poller->bw_envp);
 
     (*G_OBJECT_CLASS (xfce_sandbox_poller_parent_class)->finalize) (object);
     xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Finished finalizing the sandbox poller.");
@@ -223,39 +603,14 @@ xfce_sandbox_poller_finalize (GObject *object)
 
 
 
-typedef struct _XfceSandboxPropChangedData {
-    XfceSandboxPoller  *poller;
-    guint               ws_number;
-    const gchar        *property_name;
-    XfceSandboxProcess *found;
-} XfceSandboxPropChangedData;
-
-
-
-static void
-xfce_sandbox_poller_channel_property_update (gpointer key,
-                                             gpointer value,
-                                             gpointer user_data)
-{
-    XfceSandboxPropChangedData *data    = (XfceSandboxPropChangedData*) user_data;
-    XfceSandboxProcess         *proc    = (XfceSandboxProcess*) value;
-
-    if (data->found)
-      return;
-
-    if (proc->type == XFCE_SANDBOX_WORKSPACE && data->ws_number == proc->ws_number)
-      data->found = proc;
-}
-           
-           
-
 static void
 xfce_sandbox_poller_channel_property_changed (XfconfChannel     *channel,
                                               const gchar       *property_name,
                                               const GValue      *value,
                                               XfceSandboxPoller *poller)
 {
-    XfceSandboxPropChangedData *data;
+    XfceSandboxProcess         *proc;
+    GSList                     *pids;
     gint                        ws_number;
 
     xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "An Xfconf property ('%s') has changed.", property_name);
@@ -275,131 +630,242 @@ xfce_sandbox_poller_channel_property_changed (XfconfChannel     *channel,
       }
       xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "The changed Xfconf property ('%s') is related to Workspace security settings for workspace %d.", property_name, ws_number);
 
-      data = g_malloc (sizeof (XfceSandboxPropChangedData));
-      data->poller = poller;
-      data->ws_number = ws_number;
-      data->property_name = property_name;
-      data->found = NULL;
-
-      /* find a sandbox for the firejail domain whose property changed */
-      g_hash_table_foreach (poller->sandboxes, xfce_sandbox_poller_channel_property_update, data);
+      /* apply the change to every sandbox for the firejail domain whose property changed */
+      pids = g_hash_table_lookup (poller->workspaces, GUINT_TO_POINTER (ws_number));
+      if (pids == NULL)
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Found no running sandbox instance to which this Xfconf property applies, doing nothing.");
 
-      /* if a sandbox instance was found, apply the change */
-      if (data->found)
+      for (; pids != NULL; pids = pids->next)
       {
-        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Found a running sandbox instance to which this Xfconf property applies: %d. Applying the property now.", data->found->pid);
-        xfce_sandbox_process_apply_workspace_prop (data->found, data->property_name);
-      }
-      else
-        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Found no running sandbox instance to which this Xfconf property applies, doing nothing.");
+        proc = g_hash_table_lookup (poller->sandboxes, pids->data);
+        if (proc == NULL)
+          continue;
 
-      g_free (data);
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Found a running sandbox instance to which this Xfconf property applies: %d. Applying the property now.", proc->pid);
+        xfce_sandbox_process_apply_workspace_prop (proc, property_name);
+      }
     }
 }
 
 
 
+#define SANDBOX_ENV_WORKSPACE "FIREJAIL_SANDBOX_WORKSPACE="
+#define SANDBOX_ENV_NAME      "FIREJAIL_SANDBOX_NAME="
+
 static void
 read_sandbox_env (const gchar *env_path, pid_t client_pid, XfceSandboxType *type, gchar **name)
 {
-    FILE            *fp;
-    char            *buffer = NULL;
-    char            *value;
-    size_t           n = 0;
-    ssize_t          linelen = 0;
+    gchar           *contents;
+    gsize            length;
+    const gchar     *line;
+    const gchar     *end;
+    const gchar     *eol;
+    gboolean         workspace = FALSE;
+    GError          *error = NULL;
 
     g_return_if_fail (type && name);
     *type = XFCE_SANDBOX_UNKNOWN;
     *name = NULL;
 
-    fp = fopen(env_path, "rb");
-    if (!fp)
+    /* read the file in one go rather than line by line, environments can be
+     * large; don't map it, the sandbox may still be writing or truncating it */
+    if (!g_file_get_contents (env_path, &contents, &length, &error))
     {
-      g_warning ("Cannot open environment file '%s' to find out the sandbox type of process %d: %s", env_path, client_pid, strerror (errno));
+      g_warning ("Cannot open environment file '%s' to find out the sandbox type of process %d: %s", env_path, client_pid, error->message);
+      g_error_free (error);
       return;
     }
 
-    buffer = NULL;
-    n = 0;
-    linelen = 0;
-    errno = 0;
-    while ((linelen = getline(&buffer, &n, fp)) != -1)
-    {
-      if (buffer[linelen-1] == '\n')
-        buffer[linelen-1] = '\0';
+    line = contents;
+    end = line + length;
 
-      value = strchr(buffer, '=');
-      if (value)
+    /* stop as soon as we know both the type and the name of the sandbox */
+    while (line && line < end && !(workspace && *name))
+    {
+      /* an unterminated last line might still be being written */
+      eol = memchr (line, '\n', end - line);
+      if (!eol)
+        break;
+
+      if (!workspace
+          && (gsize) (eol - line) >= sizeof (SANDBOX_ENV_WORKSPACE) - 1
+          && memcmp (line, SANDBOX_ENV_WORKSPACE, sizeof (SANDBOX_ENV_WORKSPACE) - 1) == 0)
       {
-        *value = 0;
-        value += 1;
-
-        /* always apply the workspace type if found */
-//          xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Sandbox %d: %s = %s\n", client_pid, buffer, value);
-        if (g_strcmp0 (buffer, "FIREJAIL_SANDBOX_WORKSPACE") == 0)
-        {
-//          xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Sandbox %d is a workspace sandbox: %s\n", client_pid, value);
-          *type = XFCE_SANDBOX_WORKSPACE;
-        }
-        else if (g_strcmp0 (buffer, "FIREJAIL_SANDBOX_NAME") == 0)
-        {
-          *name = g_strdup (value);
-
-          /* only apply this one in absence of other types */
-          if (*type == XFCE_SANDBOX_UNKNOWN)
-          {
-//            xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Sandbox %d is a desktop? sandbox: %s\n", client_pid, value);
-            *type = XFCE_SANDBOX_DESKTOP;
-          }
-        }
+        workspace = TRUE;
+      }
+      else if (!*name
+               && (gsize) (eol - line) >= sizeof (SANDBOX_ENV_NAME) - 1
+               && memcmp (line, SANDBOX_ENV_NAME, sizeof (SANDBOX_ENV_NAME) - 1) == 0)
+      {
+        line += sizeof (SANDBOX_ENV_NAME) - 1;
+        *name = g_strndup (line, eol - line);
       }
 
-      free(buffer);
-      buffer = NULL;
-      n = 0;
+      line = eol + 1;
+    }
+
+    /* a named sandbox is a desktop app unless it is attached to a workspace */
+    if (workspace)
+      *type = XFCE_SANDBOX_WORKSPACE;
+    else if (*name)
+      *type = XFCE_SANDBOX_DESKTOP;
+
+    g_free (contents);
+}
+
+
+
+static void
+xfce_sandbox_pending_free (XfceSandboxPending *pending)
+{
+    g_return_if_fail (pending != NULL);
+
+    if (pending->timeout_id)
+      g_source_remove (pending->timeout_id);
+
+    if (pending->settle_id)
+      g_source_remove (pending->settle_id);
+
+    if (pending->monitor)
+    {
+      g_signal_handlers_disconnect_matched (pending->monitor, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, pending);
+      g_file_monitor_cancel (pending->monitor);
+      g_object_unref (pending->monitor);
     }
 
-    fclose(fp);
+    g_free (pending);
+}
 
-//    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Sandbox %d is a sandbox of name %s and type %d\n", client_pid, *name, *type);
-    return;
+
+
+static void
+xfce_sandbox_pending_try (XfceSandboxPending *pending)
+{
+    gboolean retry = FALSE;
+
+    pending->attempts++;
+    xfce_sandbox_poller_count (pending->poller, XFCE_SANDBOX_COUNTER_ENV_ATTEMPTS, 1);
+    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Environment of sandbox '%d' available, adding it (attempt %d).", pending->pid, pending->attempts);
+    if (xfce_sandbox_poller_add_entry_from_pid (pending->poller, pending->pid, &retry))
+      xfce_sandbox_poller_record (pending->poller, XFCE_SANDBOX_HISTOGRAM_DETECTION, xfce_sandbox_now () - pending->created);
+
+    /* the file might have been created but not fully written yet, wait for the next event */
+    if (!retry)
+      g_hash_table_remove (pending->poller->pending, GUINT_TO_POINTER (pending->pid));
 }
 
 
 
-typedef struct _XfceSandboxAddEntryIdleData {
-    XfceSandboxPoller  *poller;
-    gchar              *name;
-    gint                try_counter;
-} XfceSandboxAddEntryIdleData;
+static gboolean
+xfce_sandbox_pending_timeout (gpointer user_data)
+{
+    XfceSandboxPending *pending = (XfceSandboxPending *) user_data;
+
+    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Sandbox '%d' did not write a usable environment file in time, giving up.", pending->pid);
+    g_warning ("Sandbox '%d' did not write a usable environment file in time, cannot manage its settings.", pending->pid);
+
+    pending->timeout_id = 0;
+    xfce_sandbox_poller_count (pending->poller, XFCE_SANDBOX_COUNTER_ENV_TIMEOUTS, 1);
+    g_hash_table_remove (pending->poller->pending, GUINT_TO_POINTER (pending->pid));
 
+    return FALSE;
+}
 
 
 
 static gboolean
-xfce_sandbox_poller_add_entry_idle (gpointer user_data)
+xfce_sandbox_pending_settle (gpointer user_data)
 {
-    XfceSandboxAddEntryIdleData *data = (XfceSandboxAddEntryIdleData *) user_data;
-    gboolean                     retry = FALSE;
-    gboolean                     overran = FALSE;
+    XfceSandboxPending *pending = (XfceSandboxPending *) user_data;
+
+    /* no write finished since the file was found, it was complete already */
+    pending->settle_id = 0;
+    xfce_sandbox_pending_try (pending);
+
+    return FALSE;
+}
 
-    //FIXME possible inconsistencies, must keep guint of handler somewhere for proper cleanup
-    g_return_val_if_fail (data, FALSE);
-    g_return_val_if_fail (XFCE_IS_SANDBOX_POLLER (data->poller), FALSE);
 
-    if (data->try_counter++ == 10)
-      overran = TRUE;
-    else
-      xfce_sandbox_poller_add_entry (data->poller, data->name, &retry);
 
-    if (!retry || overran)
+static void
+xfce_sandbox_pending_on_file_changed (GFileMonitor     *monitor,
+                                      GFile            *file,
+                                      GFile            *other_file,
+                                      GFileMonitorEvent event_type,
+                                      gpointer          user_data)
+{
+    XfceSandboxPending *pending = (XfceSandboxPending *) user_data;
+    gchar              *filename;
+
+    /* only read the file once firejail closed or moved it in place */
+    if (!(event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT ||
+          event_type == G_FILE_MONITOR_EVENT_MOVED_IN))
+        return;
+
+    filename = g_file_get_basename (file);
+    if (g_strcmp0 (filename, DOMAIN_ENV_FILE) == 0)
+      xfce_sandbox_pending_try (pending);
+    g_free (filename);
+}
+
+
+
+static void
+xfce_sandbox_poller_watch_entry (XfceSandboxPoller *poller,
+                                 const gchar       *name)
+{
+    XfceSandboxPending *pending;
+    GFile              *dir;
+    gchar              *path;
+    pid_t               pid;
+    GError             *error = NULL;
+
+    g_return_if_fail (XFCE_IS_SANDBOX_POLLER (poller));
+    g_return_if_fail (name != NULL);
+
+    /* ignore the "self" entry */
+    if (g_strcmp0 ("self", name) == 0)
+      return;
+
+    pid = g_ascii_strtoll (name, NULL, 10);
+    if (!pid || g_hash_table_lookup (poller->pending, GUINT_TO_POINTER (pid)) != NULL)
+      return;
+
+    pending = g_malloc0 (sizeof (XfceSandboxPending));
+    pending->poller = poller;
+    pending->pid = pid;
+    pending->created = xfce_sandbox_now ();
+
+    /* watch the sandbox's directory for its environment file */
+    path = g_strdup_printf ("%s/%d", poller->rundir_path, pid);
+    dir = g_file_new_for_path (path);
+    pending->monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_NONE, NULL, &error);
+    g_object_unref (dir);
+
+    if (error)
     {
-      g_free (data->name);
-      g_free (data);
-      return FALSE;
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Failed to watch directory '%s' of new sandbox '%d': %s", path, pid, error->message);
+      g_warning ("Failed to watch directory '%s' of new sandbox '%d': %s\n", path, pid, error->message);
+      g_error_free (error);
+      g_free (path);
+      g_free (pending);
+      return;
     }
-    else
-      return TRUE;
+
+    g_signal_connect (G_OBJECT (pending->monitor), "changed", G_CALLBACK (xfce_sandbox_pending_on_file_changed), pending);
+    pending->timeout_id = g_timeout_add_seconds (XFCE_SANDBOX_PENDING_TIMEOUT_SEC, xfce_sandbox_pending_timeout, pending);
+    g_hash_table_insert (poller->pending, GUINT_TO_POINTER (pid), pending);
+
+    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Waiting for sandbox '%d' to write its environment file.", pid);
+
+    /* the file may have been written before the monitor was in place, or be
+     * in the middle of being written; give a running write the chance to
+     * finish and report itself before reading it */
+    g_free (path);
+    path = g_strdup_printf ("%s/%d/%s", poller->rundir_path, pid, DOMAIN_ENV_FILE);
+    if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+      pending->settle_id = g_timeout_add (XFCE_SANDBOX_PENDING_SETTLE_MS, xfce_sandbox_pending_settle, pending);
+    g_free (path);
 }
 
 
@@ -409,8 +875,8 @@ xfce_sandbox_poller_add_entry_from_pid (XfceSandboxPoller *poller,
                                         pid_t              pid,
                                         gboolean          *retry)
 {
-    XfceSandboxProcess *proc;
     XfceSandboxType     type;
+    gint64              parse_time;
     gchar              *path;
     gchar              *sandbox_name;
 
@@ -437,67 +903,82 @@ xfce_sandbox_poller_add_entry_from_pid (XfceSandboxPoller *poller,
     path = g_strdup_printf ("%s/%d/%s", poller->rundir_path, pid, DOMAIN_ENV_FILE);
     if (!g_file_test (path, G_FILE_TEST_IS_REGULAR))
     {
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Missing environment file at '%s' for sandbox '%d', cannot manage its settings.", path, pid);
-      g_warning ("Missing environment file at '%s' for sandbox '%d', cannot manage its settings.\n", path, pid);
-
       g_free (path);
 
-      /* This file is not immediately available on sandbox startup, give it a second and retry */
+      /* This file is not immediately available on sandbox startup, let the caller wait for it */
       if (retry)
+      {
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Environment file for sandbox '%d' not written yet.", pid);
         *retry = TRUE;
+      }
+      else
+      {
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Missing environment file for sandbox '%d', cannot manage its settings.", pid);
+        g_warning ("Missing environment file for sandbox '%d', cannot manage its settings.\n", pid);
+      }
 
       return FALSE;
     }
 
+    parse_time = xfce_sandbox_now ();
     read_sandbox_env (path, pid, &type, &sandbox_name);
+    xfce_sandbox_poller_record (poller, XFCE_SANDBOX_HISTOGRAM_ENV_PARSE, xfce_sandbox_now () - parse_time);
     if (type == XFCE_SANDBOX_UNKNOWN)
     {
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Could not determine type of sandbox for sandbox '%d', cannot manage its settings.", pid);
-      g_warning ("Could not determine type of sandbox for sandbox '%d', cannot manage its settings.\n", pid);
-
-      /* This file is not immediately available on sandbox startup, give it a second and retry */
+      /* This file might not be fully written yet, let the caller wait for it */
       if (retry)
+      {
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Could not determine type of sandbox for sandbox '%d' yet.", pid);
         *retry = TRUE;
+      }
+      else
+      {
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Could not determine type of sandbox for sandbox '%d', cannot manage its settings.", pid);
+        g_warning ("Could not determine type of sandbox for sandbox '%d', cannot manage its settings.\n", pid);
+      }
 
       g_free (path);
       return FALSE;
     }
 
-    /* create a process struct and add it to our list of monitored processes */
-    proc = xfce_sandbox_process_new (pid, sandbox_name, type);
-    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Adding proc object for sandbox '%d', named '%s' and of type %s.", pid, sandbox_name, type == XFCE_SANDBOX_WORKSPACE? "Workspace":"Desktop app");
+    xfce_sandbox_poller_add_process (poller, pid, type, sandbox_name);
     g_free (sandbox_name);
 
-    if (xfce_sandbox_process_start_watching (proc))
-      g_hash_table_insert (poller->sandboxes, GUINT_TO_POINTER (pid), proc);
-    else
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Proc object for sandbox '%d' cannot be watched, not adding proc object to list of managed sandboxes.", pid);
-
     g_free (path);
     return TRUE;
 }
 
 
 
-static gboolean
-xfce_sandbox_poller_add_entry (XfceSandboxPoller *poller,
-                               const gchar       *name,
-                               gboolean          *retry)
+static void
+xfce_sandbox_poller_add_process (XfceSandboxPoller *poller,
+                                 pid_t              pid,
+                                 XfceSandboxType    type,
+                                 const gchar       *name)
 {
-    pid_t               pid;
+    XfceSandboxProcess *proc;
 
-    g_return_val_if_fail (XFCE_IS_SANDBOX_POLLER (poller), FALSE);
-    g_return_val_if_fail (name != NULL, FALSE);
+    g_return_if_fail (XFCE_IS_SANDBOX_POLLER (poller));
 
-    /* ignore the "self" entry */
-    if (g_strcmp0 ("self", name) == 0)
-      return FALSE;
+    /* create a process struct and add it to our list of monitored processes */
+    proc = xfce_sandbox_process_new (poller, pid, name, type);
+    if (proc == NULL)
+      return;
 
-    pid = g_ascii_strtoll (name, NULL, 10);
-    if (!pid)
-      return FALSE;
+    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Adding proc object for sandbox '%d', named '%s' and of type %s.", pid, name, type == XFCE_SANDBOX_WORKSPACE? "Workspace":"Desktop app");
+
+    if (xfce_sandbox_process_start_watching (proc))
+    {
+      g_hash_table_insert (poller->sandboxes, GUINT_TO_POINTER (pid), proc);
+      xfce_sandbox_poller_index_process (poller, proc);
+      xfce_sandbox_poller_count (poller, XFCE_SANDBOX_COUNTER_ADDED, 1);
+    }
     else
-      return xfce_sandbox_poller_add_entry_from_pid (poller, pid, retry);
+    {
+      xfce_sandbox_poller_count (poller, XFCE_SANDBOX_COUNTER_LOOKUP_FAILURES, 1);
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Proc object for sandbox '%d' cannot be watched, not adding proc object to list of managed sandboxes.", pid);
+      xfce_sandbox_process_free (proc);
+    }
 }
 
 
@@ -539,12 +1020,93 @@ xfce_sandbox_poller_remove_entry (XfceSandboxPoller *poller,
 
 
 
+static gboolean
+xfce_sandbox_poller_scan_done (gpointer data)
+{
+    XfceSandboxPoller *poller = XFCE_SANDBOX_POLLER (data);
+    XfceSandboxScan   *scan;
+    gchar             *name;
+    guint              n_merged = 0;
+
+    /* merge whatever the workers found so far */
+    while ((scan = g_async_queue_try_pop (poller->scan_results)) != NULL)
+    {
+      /* the workers cannot touch the metrics, record their timings here */
+      if (scan->parse_time > 0)
+        xfce_sandbox_poller_record (poller, XFCE_SANDBOX_HISTOGRAM_ENV_PARSE, scan->parse_time);
+
+      /* results of a scan that was superseded by a reload */
+      if (scan->serial != poller->scan_serial)
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Dropping outdated scan result for sandbox '%d'.", scan->pid);
+      else if (scan->exited)
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Sandbox directory %d corresponds to an app that already exited, ignoring.", scan->pid);
+      else if (g_hash_table_lookup (poller->sandboxes, GUINT_TO_POINTER (scan->pid)) != NULL)
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Sandbox '%d' already added, ignoring.", scan->pid);
+      else if (scan->type == XFCE_SANDBOX_UNKNOWN)
+      {
+        /* sandboxes that were just starting up */
+        name = g_strdup_printf ("%d", scan->pid);
+        xfce_sandbox_poller_watch_entry (poller, name);
+        g_free (name);
+      }
+      else
+        xfce_sandbox_poller_add_process (poller, scan->pid, scan->type, scan->name);
+
+      g_free (scan->name);
+      g_free (scan);
+      n_merged++;
+    }
+
+    /* release the references of the workers, the idle holds its own */
+    while (n_merged-- > 0)
+      g_object_unref (G_OBJECT (poller));
+
+    return FALSE;
+}
+
+
+
+static void
+xfce_sandbox_poller_scan_entry (gpointer data,
+                                gpointer user_data)
+{
+    XfceSandboxScan   *scan = (XfceSandboxScan *) data;
+    XfceSandboxPoller *poller = scan->poller;
+    gchar             *path;
+
+    /* runs in the scan pool, only touch the scan result */
+    if (kill (scan->pid, 0) && errno == ESRCH)
+      scan->exited = TRUE;
+    else
+    {
+      path = g_strdup_printf ("%s/%d/%s", poller->rundir_path, scan->pid, DOMAIN_ENV_FILE);
+      if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+      {
+        scan->parse_time = xfce_sandbox_now ();
+        read_sandbox_env (path, scan->pid, &scan->type, &scan->name);
+        scan->parse_time = xfce_sandbox_now () - scan->parse_time;
+      }
+      g_free (path);
+    }
+
+    /* report back in the main loop; an earlier idle may merge and free the
+     * scan right after the push, so each idle keeps the poller alive itself */
+    g_object_ref (poller);
+    g_async_queue_push (poller->scan_results, scan);
+    g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, xfce_sandbox_poller_scan_done,
+                     poller, g_object_unref);
+}
+
+
+
 static gboolean
 xfce_sandbox_poller_initial_load (XfceSandboxPoller *poller, GError **error)
 {
-    GDir        *dir       = NULL;
-    gboolean     succeeded;
-    const gchar *next;
+    GDir            *dir       = NULL;
+    gboolean         succeeded;
+    const gchar     *next;
+    XfceSandboxScan *scan;
+    pid_t            pid;
 
     g_return_val_if_fail (XFCE_IS_SANDBOX_POLLER (poller), FALSE);
     g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
@@ -559,11 +1121,28 @@ xfce_sandbox_poller_initial_load (XfceSandboxPoller *poller, GError **error)
 #if HAVE_ERRNO_H
     errno = 0;
 #endif
+    if (poller->scan_pool == NULL)
+      poller->scan_pool = g_thread_pool_new (xfce_sandbox_poller_scan_entry, NULL,
+                                             XFCE_SANDBOX_SCAN_THREADS, FALSE, NULL);
+
+    /* results of a previous scan still in flight are dropped when merged */
+    poller->scan_serial++;
+
     succeeded = TRUE;
     while ((next = g_dir_read_name (dir)) != NULL)
     {
-      if (!xfce_sandbox_poller_add_entry (poller, next, NULL) && g_ascii_strtoll (next, NULL, 10))
-        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Failed to add entry %s", next);
+      /* ignore the "self" entry */
+      pid = g_ascii_strtoll (next, NULL, 10);
+      if (pid)
+      {
+        /* reading the environments is left to the pool, sandboxes are added in the main loop */
+        scan = g_malloc0 (sizeof (XfceSandboxScan));
+        scan->poller = g_object_ref (poller);
+        scan->serial = poller->scan_serial;
+        scan->pid = pid;
+        scan->type = XFCE_SANDBOX_UNKNOWN;
+        g_thread_pool_push (poller->scan_pool, scan, NULL);
+      }
 
 #if HAVE_ERRNO_H
       errno = 0;
@@ -602,18 +1181,13 @@ xfce_sandbox_poller_on_file_changed (GFileMonitor     *monitor,
 
     if (event_type == G_FILE_MONITOR_EVENT_CREATED)
     {
-        XfceSandboxAddEntryIdleData *data = g_malloc (sizeof (XfceSandboxAddEntryIdleData));
-
-        data->poller = poller;
-        data->name = g_strdup (filename);
-        data->try_counter = 0;
-
-        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "File '%s' created, adding it in a few moments", filename);
-        g_timeout_add_seconds (1, xfce_sandbox_poller_add_entry_idle, data);
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "File '%s' created, adding it once its environment is written", filename);
+        xfce_sandbox_poller_watch_entry (poller, filename);
     }
     else if (event_type == G_FILE_MONITOR_EVENT_DELETED)
     {
         xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "File '%s' deleted", filename);
+        g_hash_table_remove (poller->pending, GUINT_TO_POINTER (g_ascii_strtoll (filename, NULL, 10)));
         xfce_sandbox_poller_remove_entry (poller, filename);
     }
     else if (event_type == G_FILE_MONITOR_EVENT_PRE_UNMOUNT)
@@ -669,6 +1243,10 @@ xfce_sandbox_poller_reload (XfceSandboxPoller *poller)
       xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "... removing existing sandboxes from hash table.");
       g_hash_table_remove_all (poller->sandboxes);
     }
+    g_hash_table_remove_all (poller->pending);
+
+    /* .desktop files may have changed while we were not watching */
+    poller->desktop_index_valid = FALSE;
 
     /* load existing sandboxes' parameters */
     xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "... applying settings for existing sandboxes.");
@@ -763,9 +1341,10 @@ xfce_sandbox_poller_unload (XfceSandboxPoller *poller)
 
 
 static XfceSandboxProcess *
-xfce_sandbox_process_new (pid_t            pid,
-                          const gchar     *name,
-                          XfceSandboxType  type)
+xfce_sandbox_process_new (XfceSandboxPoller *poller,
+                          pid_t              pid,
+                          const gchar       *name,
+                          XfceSandboxType    type)
 {
     XfceSandboxProcess *proc;
 
@@ -775,6 +1354,7 @@ xfce_sandbox_process_new (pid_t            pid,
     proc = g_malloc (sizeof (XfceSandboxProcess));
     g_return_val_if_fail (proc != NULL, NULL);
 
+    proc->poller = poller;
     proc->pid  = pid;
     proc->name = g_strdup (name);
     proc->type = type;
@@ -795,6 +1375,8 @@ xfce_sandbox_process_free (XfceSandboxProcess *proc)
 {
     g_return_if_fail (proc != NULL);
 
+    xfce_sandbox_poller_unindex_process (proc->poller, proc);
+
     if (proc->desktop_path)
       g_free (proc->desktop_path);
 
@@ -804,19 +1386,288 @@ xfce_sandbox_process_free (XfceSandboxProcess *proc)
 
 
 
+static gchar **
+xfce_sandbox_poller_build_envp (void)
+{
+    gchar **envp;
+    guint   n;
+    guint   n_envp;
+
+    /* clean up path in the environment so we're confident the sandbox properly set up */
+    for (n = 0; environ && environ[n] != NULL; ++n);
+    envp = g_new0 (gchar *, n + 2);
+    for (n_envp = n = 0; environ && environ[n] != NULL; ++n)
+    {
+      if (strncmp (environ[n], "DESKTOP_STARTUP_ID", 18) != 0
+          && strncmp (environ[n], "PATH", 4) != 0)
+        envp[n_envp++] = g_strdup (environ[n]);
+    }
+    envp[n_envp++] = g_strdup ("PATH=/usr/local/sbin:/usr/local/bin:/usr/bin:/usr/sbin:/sbin");
+
+    return envp;
+}
+
+
+
+static void
+xfce_sandbox_bandwidth_free (XfceSandboxBandwidth *bw)
+{
+    g_return_if_fail (bw != NULL);
+
+    g_free (bw->name);
+    g_free (bw);
+}
+
+
+
+static void
+xfce_sandbox_poller_bandwidth_result (XfceSandboxPoller    *poller,
+                                      XfceSandboxBandwidth *bw,
+                                      gboolean              succeeded)
+{
+    XfceSandboxBandwidthState *state;
+    gint64                     delay;
+
+    /* the sandboxes of this name may be gone already */
+    state = g_hash_table_lookup (poller->bw_state, bw->name);
+    if (state == NULL)
+      return;
+
+    if (succeeded)
+    {
+      state->have_download = bw->download;
+      state->have_upload = bw->upload;
+      state->applied = TRUE;
+      state->failures = 0;
+      state->retry_after = 0;
+    }
+    else
+    {
+      /* back off exponentially, so a broken firejail is not hammered every cycle */
+      state->failures++;
+      delay = (gint64) XFCE_SANDBOX_RECONCILE_INTERVAL_SEC << MIN (state->failures - 1, 10);
+      delay = MIN (delay, XFCE_SANDBOX_BACKOFF_MAX_SEC);
+      state->retry_after = xfce_sandbox_now () + delay * G_USEC_PER_SEC;
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Bandwidth limits of '%s' failed %d times, retrying in %d seconds", bw->name, state->failures, (gint) delay);
+
+      /* only wake up while there is something to retry */
+      if (poller->reconcile_id == 0)
+        poller->reconcile_id = g_timeout_add_seconds (XFCE_SANDBOX_RECONCILE_INTERVAL_SEC, xfce_sandbox_poller_reconcile, poller);
+    }
+}
+
+
+
+static gboolean
+xfce_sandbox_poller_reconcile (gpointer user_data)
+{
+    XfceSandboxPoller         *poller = XFCE_SANDBOX_POLLER (user_data);
+    XfceSandboxBandwidthState *state;
+    GHashTableIter             iter;
+    gpointer                   key, value;
+    GSList                    *drifted = NULL;
+    GSList                    *li;
+    guint                      budget = XFCE_SANDBOX_RECONCILE_BATCH;
+    gint64                     now = xfce_sandbox_now ();
+    gboolean                   unapplied = FALSE;
+
+    /* retry the limits that are not in effect, at most a batch per cycle; this
+     * only knows about the limits set_bandwidth was asked for, it does not
+     * re-read the desired limits from xfconf or the .desktop files */
+    g_hash_table_iter_init (&iter, poller->bw_state);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      state = value;
+
+      if (state->applied
+          && state->have_download == state->want_download
+          && state->have_upload == state->want_upload)
+        continue;
+
+      unapplied = TRUE;
+
+      /* already on its way, backing off, or enough for this cycle */
+      if (budget == 0
+          || g_hash_table_lookup (poller->bw_queued, key) != NULL
+          || (poller->bw_running != NULL && g_strcmp0 (poller->bw_running->name, key) == 0)
+          || state->retry_after > now)
+        continue;
+
+      drifted = g_slist_prepend (drifted, key);
+      budget--;
+    }
+
+    for (li = drifted; li != NULL; li = li->next)
+    {
+      state = g_hash_table_lookup (poller->bw_state, li->data);
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Bandwidth limits of '%s' are not in effect, applying them again", (const gchar *) li->data);
+      xfce_sandbox_poller_count (poller, XFCE_SANDBOX_COUNTER_RECONCILED, 1);
+      xfce_sandbox_poller_set_bandwidth (poller, li->data, state->want_download, state->want_upload);
+    }
+
+    g_slist_free (drifted);
+
+    /* stop waking up once every limit is in effect, a failure re-arms the timer */
+    if (!unapplied)
+      poller->reconcile_id = 0;
+
+    return unapplied;
+}
+
+
+
+static void
+xfce_sandbox_poller_bandwidth_done (GPid     pid,
+                                    gint     status,
+                                    gpointer user_data)
+{
+    XfceSandboxPoller *poller = XFCE_SANDBOX_POLLER (user_data);
+
+    if (WIFEXITED (status) && WEXITSTATUS (status) == 0)
+    {
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Firejail (PID %d) successfully updated bandwidth limits", pid);
+      xfce_sandbox_poller_record (poller, XFCE_SANDBOX_HISTOGRAM_ENFORCEMENT, xfce_sandbox_now () - poller->bw_started);
+      xfce_sandbox_poller_bandwidth_result (poller, poller->bw_running, TRUE);
+    }
+    else
+    {
+      xfce_sandbox_poller_count (poller, XFCE_SANDBOX_COUNTER_FIREJAIL_FAILURES, 1);
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Firejail (PID %d) failed to update bandwidth limits (status %d)", pid, status);
+      g_warning ("Firejail failed to update bandwidth limits (status %d)\n", status);
+      xfce_sandbox_poller_bandwidth_result (poller, poller->bw_running, FALSE);
+    }
+
+    g_spawn_close_pid (pid);
+    xfce_sandbox_bandwidth_free (poller->bw_running);
+    poller->bw_running = NULL;
+    poller->bw_pid = 0;
+    poller->bw_watch_id = 0;
+
+    /* start the next update, if any */
+    xfce_sandbox_poller_run_bandwidth (poller);
+}
+
+
+
+static void
+xfce_sandbox_poller_run_bandwidth (XfceSandboxPoller *poller)
+{
+    XfceSandboxBandwidth *bw;
+    gchar                *argv[7];
+    guint                 n;
+    gboolean              succeeded = FALSE;
+    GError               *error = NULL;
+    gint64                spawn_time;
+
+    g_return_if_fail (XFCE_IS_SANDBOX_POLLER (poller));
+
+    /* firejail has no batch mode, so run one update at a time rather than a burst of processes */
+    while (poller->bw_pid == 0 && !succeeded)
+    {
+      bw = g_queue_pop_head (poller->bw_queue);
+      if (bw == NULL)
+        return;
+
+      g_hash_table_remove (poller->bw_queued, bw->name);
+
+      argv[0] = "firejail";
+      argv[1] = g_strdup_printf ("--bandwidth=%s", bw->name);
+      argv[2] = "set";
+      argv[3] = "auto";
+      argv[4] = g_strdup_printf ("%d", bw->download);
+      argv[5] = g_strdup_printf ("%d", bw->upload);
+      argv[6] = NULL;
+
+      for (n = 0; argv[n]; n++)
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "argv[%d] -> %s", n, argv[n]);
+
+      spawn_time = xfce_sandbox_now ();
+      succeeded = g_spawn_async (NULL, argv, poller->bw_envp,
+                                 G_SPAWN_SEARCH_PATH_FROM_ENVP | G_SPAWN_DO_NOT_REAP_CHILD,
+                                 NULL, NULL, &poller->bw_pid, &error);
+      xfce_sandbox_poller_record (poller, XFCE_SANDBOX_HISTOGRAM_SPAWN, xfce_sandbox_now () - spawn_time);
+      if (!succeeded)
+      {
+        xfce_sandbox_poller_count (poller, XFCE_SANDBOX_COUNTER_SPAWN_FAILURES, 1);
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Failed to execute firejail to update bandwidth limits of '%s': %s", bw->name, error->message);
+        g_warning ("Failed to execute firejail to update bandwidth limits of '%s': %s\n", bw->name, error->message);
+        g_error_free (error);
+        error = NULL;
+        poller->bw_pid = 0;
+        xfce_sandbox_poller_bandwidth_result (poller, bw, FALSE);
+        xfce_sandbox_bandwidth_free (bw);
+      }
+      else
+      {
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Firejail (PID %d) executed for sandbox '%s'", poller->bw_pid, bw->name);
+        poller->bw_started = bw->queued;
+        poller->bw_running = bw;
+        poller->bw_watch_id = g_child_watch_add_full (G_PRIORITY_DEFAULT, poller->bw_pid,
+                                                      xfce_sandbox_poller_bandwidth_done,
+                                                      g_object_ref (poller), g_object_unref);
+      }
+
+      g_free (argv[1]);
+      g_free (argv[4]);
+      g_free (argv[5]);
+    }
+}
+
+
+
+static void
+xfce_sandbox_poller_set_bandwidth (XfceSandboxPoller *poller,
+                                   const gchar       *name,
+                                   gint               download,
+                                   gint               upload)
+{
+    XfceSandboxBandwidth      *bw;
+    XfceSandboxBandwidthState *state;
+
+    g_return_if_fail (XFCE_IS_SANDBOX_POLLER (poller));
+    g_return_if_fail (name != NULL);
+
+    /* remember what we want, the retry loop re-applies it if firejail fails */
+    state = g_hash_table_lookup (poller->bw_state, name);
+    if (state == NULL)
+    {
+      state = g_new0 (XfceSandboxBandwidthState, 1);
+      g_hash_table_insert (poller->bw_state, g_strdup (name), state);
+    }
+    state->want_download = download;
+    state->want_upload = upload;
+
+    /* an update still waiting for this sandbox is simply overwritten */
+    bw = g_hash_table_lookup (poller->bw_queued, name);
+    if (bw == NULL)
+    {
+      bw = g_malloc (sizeof (XfceSandboxBandwidth));
+      bw->name = g_strdup (name);
+      bw->queued = xfce_sandbox_now ();
+      g_queue_push_tail (poller->bw_queue, bw);
+      g_hash_table_insert (poller->bw_queued, bw->name, bw);
+    }
+    else
+    {
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Merging bandwidth update for sandbox '%s' with a queued one", name);
+      xfce_sandbox_poller_count (poller, XFCE_SANDBOX_COUNTER_BANDWIDTH_MERGED, 1);
+    }
+
+    xfce_sandbox_poller_count (poller, XFCE_SANDBOX_COUNTER_BANDWIDTH_UPDATES, 1);
+
+    bw->download = download;
+    bw->upload = upload;
+
+    xfce_sandbox_poller_run_bandwidth (poller);
+}
+
+
+
 static gboolean
 xfce_sandbox_process_apply_workspace_prop (XfceSandboxProcess *proc,
                                            const gchar *property_name)
 {
     gchar     *key;
-    gchar    **argv = NULL;
-    gchar    **envp = NULL;
-    gchar     *new_path = NULL;
-    guint      n;
-    guint      n_envp;
-    gboolean   succeeded;
-    GError    *error = NULL;
-    GPid       pid;
 
     g_return_val_if_fail (proc != NULL, FALSE);
     g_return_val_if_fail (property_name != NULL, FALSE);
@@ -828,7 +1679,7 @@ xfce_sandbox_process_apply_workspace_prop (XfceSandboxProcess *proc,
 
     key++;
 
-    /* find out if the modified property is managed by xfsettingsd, if so, build a command */
+    /* find out if the modified property is managed by xfsettingsd, if so, queue an update */
     if (g_strcmp0 (key, "bandwidth_download") == 0 || g_strcmp0 (key, "bandwidth_upload") == 0)
     {
       /* Exit if there is no Internet connection in the sandbox */
@@ -838,15 +1689,10 @@ xfce_sandbox_process_apply_workspace_prop (XfceSandboxProcess *proc,
         return TRUE;
       }
 
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Network property, about to execute Firejail");
-      argv = g_malloc0 (sizeof (char *) * 7);
-      argv[0] = g_strdup ("firejail");
-      argv[1] = g_strdup_printf ("--bandwidth=%s", proc->name);
-      argv[2] = g_strdup ("set");
-      argv[3] = g_strdup ("auto");
-      argv[4] = g_strdup_printf ("%d", xfce_workspace_download_speed (proc->ws_number));
-      argv[5] = g_strdup_printf ("%d", xfce_workspace_upload_speed (proc->ws_number));
-      argv[6] = NULL;
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Network property, queueing a bandwidth update");
+      xfce_sandbox_poller_set_bandwidth (proc->poller, proc->name,
+                                         xfce_workspace_download_speed (proc->ws_number),
+                                         xfce_workspace_upload_speed (proc->ws_number));
     }
     else if (g_strcmp0 (key, "proxy_ip") == 0)
     {
@@ -857,40 +1703,84 @@ xfce_sandbox_process_apply_workspace_prop (XfceSandboxProcess *proc,
       g_info ("Proxy port setting is not yet supported for Firejail sandboxes. Cannot update proxy port for workspace '%s'", proc->name);    
     }
 
-    /* if there's no command to execute, just leave now */
-    if (!argv)
-      return TRUE;
+    return TRUE;
+}
 
-    /* clean up path in the environment so we're confident the sandbox properly set up */
-    for (n = 0; environ && environ[n] != NULL; ++n);
-    envp = g_new0 (gchar *, n + 2);
-    for (n_envp = n = 0; environ[n] != NULL; ++n)
+
+
+static XfceSandboxDesktopPolicy *
+xfce_sandbox_poller_desktop_policy (XfceSandboxPoller *poller,
+                                    const gchar       *path,
+                                    gboolean          *changed)
+{
+    XfceSandboxDesktopPolicy *policy;
+    XfceSandboxDesktopPolicy  parsed;
+    GKeyFile                 *key_file;
+    struct stat               st;
+    GError                   *error = NULL;
+
+    if (changed)
+      *changed = FALSE;
+
+    if (stat (path, &st) != 0)
     {
-      if (strncmp (environ[n], "DESKTOP_STARTUP_ID", 18) != 0
-          && strncmp (environ[n], "PATH", 4) != 0)
-        envp[n_envp++] = environ[n];
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Could not stat .desktop file %s: %s", path, g_strerror (errno));
+      g_hash_table_remove (poller->desktop_policies, path);
+      return NULL;
     }
-    envp[n_envp++] = new_path = g_strdup ("PATH=/usr/local/sbin:/usr/local/bin:/usr/bin:/usr/sbin:/sbin");
 
-    for (n = 0; argv[n]; n++)
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "argv[%d] -> %s", n, argv[n]);
-    succeeded = g_spawn_async (NULL, argv, envp, G_SPAWN_SEARCH_PATH_FROM_ENVP, NULL, NULL, &pid, &error);
-    
-    if (!succeeded)
+    /* the file was not replaced nor modified since we parsed it; callers asking
+     * what changed react to a monitor event, and a same-size edit within the
+     * mtime granularity would look unmodified, so always parse for them */
+    policy = g_hash_table_lookup (poller->desktop_policies, path);
+    if (policy != NULL
+        && changed == NULL
+        && policy->dev == st.st_dev
+        && policy->ino == st.st_ino
+        && policy->mtime == st.st_mtime
+        && policy->size == st.st_size)
+      return policy;
+
+    key_file = g_key_file_new ();
+    g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, &error);
+    if (error)
     {
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Failed to execute firejail to update property '%s': %s", property_name, error->message);
-      g_warning ("Failed to execute firejail to update property '%s': %s\n", property_name, error->message);
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Could not load .desktop file %s: %s", path, error->message);
       g_error_free (error);
-      error = NULL;
+      g_key_file_free (key_file);
+      g_hash_table_remove (poller->desktop_policies, path);
+      return NULL;
     }
-    else
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Firejail successfully executed, property '%s' is now updated", property_name);
 
-    g_strfreev (argv);
-    g_free (new_path);
-    g_free (envp);
+    parsed.dev = st.st_dev;
+    parsed.ino = st.st_ino;
+    parsed.mtime = st.st_mtime;
+    parsed.size = st.st_size;
 
-    return succeeded;
+    parsed.network = !g_key_file_has_key (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_ENABLE_NETWORK_KEY, NULL) ||
+                     g_key_file_get_boolean (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_ENABLE_NETWORK_KEY, NULL);
+    parsed.download = g_key_file_has_key (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_BANDWIDTH_DOWNLOAD_KEY, NULL)?
+                           g_key_file_get_integer (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_BANDWIDTH_DOWNLOAD_KEY, NULL) : XFCE_FIREJAIL_BANDWIDTH_DOWNLOAD_DEFAULT;
+    parsed.upload = g_key_file_has_key (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_BANDWIDTH_UPLOAD_KEY, NULL)?
+                           g_key_file_get_integer (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_BANDWIDTH_UPLOAD_KEY, NULL) : XFCE_FIREJAIL_BANDWIDTH_UPLOAD_DEFAULT;
+
+    g_key_file_free (key_file);
+
+    /* only report a change if it affects the sandbox */
+    if (changed)
+      *changed = policy == NULL
+                 || policy->network != parsed.network
+                 || policy->download != parsed.download
+                 || policy->upload != parsed.upload;
+
+    if (policy == NULL)
+    {
+      policy = g_new (XfceSandboxDesktopPolicy, 1);
+      g_hash_table_insert (poller->desktop_policies, g_strdup (path), policy);
+    }
+    *policy = parsed;
+
+    return policy;
 }
 
 
@@ -898,123 +1788,180 @@ xfce_sandbox_process_apply_workspace_prop (XfceSandboxProcess *proc,
 static gboolean
 xfce_sandbox_process_apply_desktop_props (XfceSandboxProcess *proc)
 {
-    GKeyFile  *key_file;
-    gint       dl, ul;
-    gchar    **argv = NULL;
-    gchar    **envp = NULL;
-    gchar     *new_path = NULL;
-    guint      n;
-    guint      n_envp;
-    gboolean   succeeded;
-    GError    *error = NULL;
-    GPid       pid;
+    XfceSandboxDesktopPolicy *policy;
 
     g_return_val_if_fail (proc != NULL, FALSE);
     g_return_val_if_fail (proc->desktop_path != NULL, FALSE);
     xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Applying settings for desktop app %s", proc->name);
-    
-    key_file = g_key_file_new ();
-    g_key_file_load_from_file (key_file, proc->desktop_path, G_KEY_FILE_NONE, &error);
-    if (error)
+
+    policy = xfce_sandbox_poller_desktop_policy (proc->poller, proc->desktop_path, NULL);
+    if (policy == NULL)
     {
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Could not load Desktop app %s 's .desktop file: %s. Not managing sandbox %d's settings.", proc->name, error->message, proc->pid);
-      g_warning ("Could not load Desktop app %s 's .desktop file: %s. Not managing sandbox %d's settings.\n", proc->name, error->message, proc->pid);
-      g_error_free (error);
-      error = NULL;
+      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Could not load Desktop app %s 's .desktop file. Not managing sandbox %d's settings.", proc->name, proc->pid);
+      g_warning ("Could not load Desktop app %s 's .desktop file. Not managing sandbox %d's settings.\n", proc->name, proc->pid);
       return FALSE;
     }
 
     xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Applying bandwidth limits to desktop app %s", proc->name);
 
     /* Exit if there is no Internet connection in the sandbox */
-    if (g_key_file_has_key (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_ENABLE_NETWORK_KEY, NULL) &&
-        !g_key_file_get_boolean (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_ENABLE_NETWORK_KEY, NULL))
+    if (!policy->network)
     {
       xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Desktop app %s does not have an Internet connection, nothing to do", proc->name);
-      g_key_file_free (key_file);
       return TRUE;
     }
 
-    dl = g_key_file_has_key (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_BANDWIDTH_DOWNLOAD_KEY, NULL)?
-                           g_key_file_get_integer (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_BANDWIDTH_DOWNLOAD_KEY, NULL) : XFCE_FIREJAIL_BANDWIDTH_DOWNLOAD_DEFAULT;
-    ul = g_key_file_has_key (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_BANDWIDTH_UPLOAD_KEY, NULL)?
-                           g_key_file_get_integer (key_file, G_KEY_FILE_DESKTOP_GROUP, XFCE_FIREJAIL_BANDWIDTH_UPLOAD_KEY, NULL) : XFCE_FIREJAIL_BANDWIDTH_UPLOAD_DEFAULT;
+    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Network property, queueing a bandwidth update");
+    xfce_sandbox_poller_set_bandwidth (proc->poller, proc->name, policy->download, policy->upload);
 
-    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Network property, about to execute Firejail");
-    argv = g_malloc0 (sizeof (char *) * 7);
-    argv[0] = g_strdup ("firejail");
-    argv[1] = g_strdup_printf ("--bandwidth=%s", proc->name);
-    argv[2] = g_strdup ("set");
-    argv[3] = g_strdup ("auto");
-    argv[4] = g_strdup_printf ("%d", dl);
-    argv[5] = g_strdup_printf ("%d", ul);
-    argv[6] = NULL;
+    return TRUE;
+}
 
-    /* clean up path in the environment so we're confident the sandbox properly set up */
-    for (n = 0; environ && environ[n] != NULL; ++n);
-    envp = g_new0 (gchar *, n + 2);
-    for (n_envp = n = 0; environ[n] != NULL; ++n)
+
+
+static void
+xfce_sandbox_poller_index_process (XfceSandboxPoller  *poller,
+                                   XfceSandboxProcess *proc)
+{
+    GSList *pids;
+
+    g_return_if_fail (XFCE_IS_SANDBOX_POLLER (poller));
+    g_return_if_fail (proc != NULL);
+
+    pids = g_hash_table_lookup (poller->names, proc->name);
+    if (pids == NULL)
+      g_hash_table_insert (poller->names, g_strdup (proc->name), g_slist_prepend (NULL, GUINT_TO_POINTER (proc->pid)));
+    else if (g_slist_find (pids, GUINT_TO_POINTER (proc->pid)) == NULL)
+      pids->next = g_slist_prepend (pids->next, GUINT_TO_POINTER (proc->pid));
+
+    if (proc->type != XFCE_SANDBOX_WORKSPACE)
+      return;
+
+    pids = g_hash_table_lookup (poller->workspaces, GUINT_TO_POINTER (proc->ws_number));
+    if (pids == NULL)
+      g_hash_table_insert (poller->workspaces, GUINT_TO_POINTER (proc->ws_number), g_slist_prepend (NULL, GUINT_TO_POINTER (proc->pid)));
+    else if (g_slist_find (pids, GUINT_TO_POINTER (proc->pid)) == NULL)
+      pids->next = g_slist_prepend (pids->next, GUINT_TO_POINTER (proc->pid));
+}
+
+
+
+static void
+xfce_sandbox_poller_unindex_process (XfceSandboxPoller  *poller,
+                                     XfceSandboxProcess *proc)
+{
+    GSList *pids;
+
+    g_return_if_fail (XFCE_IS_SANDBOX_POLLER (poller));
+    g_return_if_fail (proc != NULL);
+
+    pids = g_hash_table_lookup (poller->names, proc->name);
+    if (pids != NULL)
     {
-      if (strncmp (environ[n], "DESKTOP_STARTUP_ID", 18) != 0
-          && strncmp (environ[n], "PATH", 4) != 0)
-        envp[n_envp++] = environ[n];
+      pids = g_slist_remove (pids, GUINT_TO_POINTER (proc->pid));
+      if (pids == NULL)
+      {
+        /* nothing left to enforce limits on */
+        g_hash_table_remove (poller->names, proc->name);
+        g_hash_table_remove (poller->bw_state, proc->name);
+      }
+      else
+        g_hash_table_insert (poller->names, g_strdup (proc->name), pids);
     }
-    envp[n_envp++] = new_path = g_strdup ("PATH=/usr/local/sbin:/usr/local/bin:/usr/bin:/usr/sbin:/sbin");
 
-    for (n = 0; argv[n]; n++)
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "argv[%d] -> %s", n, argv[n]);
-    succeeded = g_spawn_async (NULL, argv, envp, G_SPAWN_SEARCH_PATH_FROM_ENVP, NULL, NULL, &pid, &error);
-    
-    if (!succeeded)
+    if (proc->type != XFCE_SANDBOX_WORKSPACE)
+      return;
+
+    pids = g_hash_table_lookup (poller->workspaces, GUINT_TO_POINTER (proc->ws_number));
+    if (pids != NULL)
     {
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Failed to execute firejail to update bandwidth limits: %s", error->message);
-      g_warning ("Failed to execute firejail to update bandwidth limits: %s\n", error->message);
-      g_error_free (error);
-      error = NULL;
+      pids = g_slist_remove (pids, GUINT_TO_POINTER (proc->pid));
+      if (pids == NULL)
+        g_hash_table_remove (poller->workspaces, GUINT_TO_POINTER (proc->ws_number));
+      else
+        g_hash_table_insert (poller->workspaces, GUINT_TO_POINTER (proc->ws_number), pids);
     }
-    else
-      xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Firejail successfully executed, bandwidth limits now updated");
+}
 
-    g_strfreev (argv);
-    g_free (new_path);
-    g_free (envp);
-    g_key_file_free (key_file);
 
-    return succeeded;
+
+static void
+xfce_sandbox_poller_desktop_index_add (XfceSandboxPoller *poller,
+                                       const gchar       *name,
+                                       const gchar       *path)
+{
+    g_hash_table_insert (poller->desktop_index, g_strdup (name), g_strdup (path));
+    g_hash_table_insert (poller->desktop_paths, g_strdup (path), g_strdup (name));
 }
 
 
 
-static gchar *
-find_desktop_path_from_name (XfceSandboxProcess *proc)
+static void
+xfce_sandbox_poller_desktop_index_remove (XfceSandboxPoller *poller,
+                                          const gchar       *path)
+{
+    const gchar *name;
+
+    name = g_hash_table_lookup (poller->desktop_paths, path);
+    if (name == NULL)
+      return;
+
+    /* only drop the name if it was provided by this very file */
+    if (g_strcmp0 (g_hash_table_lookup (poller->desktop_index, name), path) == 0)
+      g_hash_table_remove (poller->desktop_index, name);
+
+    g_hash_table_remove (poller->desktop_paths, path);
+}
+
+
+
+static void
+xfce_sandbox_poller_desktop_index_rebuild (XfceSandboxPoller *poller)
 {
     GList *infos;
     GList *iter;
-    gchar *path = NULL;
 
-    g_return_val_if_fail (proc != NULL, NULL);
+    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Rebuilding the index of Desktop apps.");
+
+    g_hash_table_remove_all (poller->desktop_index);
+    g_hash_table_remove_all (poller->desktop_paths);
 
     infos = g_app_info_get_all ();
 
-    for (iter = infos; path == NULL && iter != NULL; iter = iter->next)
+    for (iter = infos; iter != NULL; iter = iter->next)
     {
       GAppInfo    *info = iter->data;
       const gchar *info_name = g_app_info_get_name (info);
+      const gchar *path;
 
-      if (g_strcmp0 (info_name, proc->name) == 0 && G_IS_DESKTOP_APP_INFO (info))
-      {
-        path = g_strdup (g_desktop_app_info_get_filename (G_DESKTOP_APP_INFO (info)));
-        if (path == NULL)
-        {
-          xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Found a Desktop App Info that matches sandbox %d's name %s, but it did not have a filename.", proc->pid, proc->name);
-          g_warning ("Found a Desktop App Info that matches sandbox %d's name %s, but it did not have a filename.\n", proc->pid, proc->name);
-        }
-      }
+      if (info_name == NULL || !G_IS_DESKTOP_APP_INFO (info))
+        continue;
+
+      /* the first Desktop app with a given name wins, as in the XDG lookup order */
+      path = g_desktop_app_info_get_filename (G_DESKTOP_APP_INFO (info));
+      if (path != NULL && g_hash_table_lookup (poller->desktop_index, info_name) == NULL)
+        xfce_sandbox_poller_desktop_index_add (poller, info_name, path);
     }
 
     g_list_free_full (infos, g_object_unref);
 
-    return path;
+    poller->desktop_index_valid = TRUE;
+    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Indexed %d Desktop apps.", g_hash_table_size (poller->desktop_index));
+}
+
+
+
+static gchar *
+find_desktop_path_from_name (XfceSandboxPoller *poller,
+                             const gchar       *name)
+{
+    g_return_val_if_fail (XFCE_IS_SANDBOX_POLLER (poller), NULL);
+    g_return_val_if_fail (name != NULL, NULL);
+
+    if (!poller->desktop_index_valid)
+      xfce_sandbox_poller_desktop_index_rebuild (poller);
+
+    return g_strdup (g_hash_table_lookup (poller->desktop_index, name));
 }
 
 
@@ -1029,69 +1976,105 @@ xfce_sandbox_poller_on_desktop_changed (GFileMonitor     *monitor,
     XfceSandboxPoller  *poller = (XfceSandboxPoller *) user_data;
     GDesktopAppInfo    *appinfo = NULL;
     gchar              *new_path = NULL;
-    const gchar        *name = NULL;
-    GHashTableIter      iter;
-    gpointer            key, value;
-    pid_t               pending = 0;
+    gchar              *name = NULL;
+    const gchar        *indexed;
+    GSList             *pids;
+    GSList             *iter;
+    pid_t               pending;
     XfceSandboxProcess *proc;
+    gboolean            changed = FALSE;
 
     if (!(event_type == G_FILE_MONITOR_EVENT_CHANGED ||
           event_type == G_FILE_MONITOR_EVENT_DELETED ||
           event_type == G_FILE_MONITOR_EVENT_CREATED))
         return;
 
-    /* Verify the file is an appinfo */
     new_path = g_file_get_path (file);
     xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "A .desktop file changed: %s.", new_path);
 
-    appinfo = g_desktop_app_info_new_from_filename (new_path);
-    if (!appinfo)
-    {
-        g_free (new_path);
-        return;
-    }
+    /* Forget what the file used to provide */
+    name = g_strdup (g_hash_table_lookup (poller->desktop_paths, new_path));
+    xfce_sandbox_poller_desktop_index_remove (poller, new_path);
 
-    /* Find out if a sandbox with the same name exists */
-    name = g_app_info_get_name (G_APP_INFO (appinfo));
-    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "The .desktop file changed corresponds to Desktop app '%s'.", name);
+    if (event_type == G_FILE_MONITOR_EVENT_DELETED)
+    {
+        g_hash_table_remove (poller->desktop_policies, new_path);
 
-    g_hash_table_iter_init (&iter, poller->sandboxes);
-    while (g_hash_table_iter_next (&iter, &key, &value) && !pending)
+        /* another file might provide the same name, let the next lookup find out */
+        if (name)
+          poller->desktop_index_valid = FALSE;
+    }
+    else
     {
-        proc = (XfceSandboxProcess *) value;
-        if (g_strcmp0 (proc->name, name) == 0)
-            pending = GPOINTER_TO_UINT (key);
+        /* Verify the file is an appinfo */
+        appinfo = g_desktop_app_info_new_from_filename (new_path);
+        if (appinfo)
+        {
+            /* the previous name of a renamed app may now resolve to another file */
+            if (name && g_strcmp0 (name, g_app_info_get_name (G_APP_INFO (appinfo))) != 0)
+                poller->desktop_index_valid = FALSE;
+
+            g_free (name);
+            name = g_strdup (g_app_info_get_name (G_APP_INFO (appinfo)));
+            g_object_unref (appinfo);
+
+            indexed = g_hash_table_lookup (poller->desktop_index, name);
+            if (indexed == NULL)
+                xfce_sandbox_poller_desktop_index_add (poller, name, new_path);
+            else if (event_type == G_FILE_MONITOR_EVENT_CREATED)
+                /* the new file might supersede the indexed one, let the next lookup sort it out */
+                poller->desktop_index_valid = FALSE;
+        }
     }
 
-    g_object_unref (appinfo);
-
-    if (!pending)
+    if (!name)
     {
         g_free (new_path);
         return;
     }
 
-    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "A matching process (PID %d) was found for Desktop app '%s'.", pending, proc->name);
+    xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "The .desktop file changed corresponds to Desktop app '%s'.", name);
 
-    /* Just gotta re-read the same file */
-    if (g_strcmp0 (proc->desktop_path, new_path) == 0 && (event_type == G_FILE_MONITOR_EVENT_CHANGED || event_type == G_FILE_MONITOR_EVENT_CREATED))
-    {
-        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Reloading settings for process %d...", pending);
-        xfce_sandbox_process_apply_desktop_props (proc);
-        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Done reloading settings for process %d...", pending);
-    }
+    /* Find out if sandboxes with the same name exist, the list changes as they get reloaded */
+    pids = g_slist_copy (g_hash_table_lookup (poller->names, name));
+
+    /* Package upgrades touch files without changing their sandbox settings */
+    if (pids != NULL && event_type != G_FILE_MONITOR_EVENT_DELETED)
+        xfce_sandbox_poller_desktop_policy (poller, new_path, &changed);
+    else
+        g_hash_table_remove (poller->desktop_policies, new_path);
 
-    /* Depending on the GAppinfo path traversal logic, the created file might
-       supersede the existing one for our sandbox, or another file might replace
-       the deleted file. Just re-add the sandbox */
-    if (event_type != G_FILE_MONITOR_EVENT_CHANGED)
+    for (iter = pids; iter != NULL; iter = iter->next)
     {
-        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Reloading process %d entirely...", pending);
-        if (xfce_sandbox_poller_remove_entry_from_pid (poller, pending))
-            xfce_sandbox_poller_add_entry_from_pid (poller, pending, NULL);
-        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Done reloading process %d entirely...", pending);
+        pending = GPOINTER_TO_UINT (iter->data);
+        proc = g_hash_table_lookup (poller->sandboxes, iter->data);
+        if (proc == NULL || proc->type != XFCE_SANDBOX_DESKTOP)
+            continue;
+
+        xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "A matching process (PID %d) was found for Desktop app '%s'.", pending, name);
+
+        /* Just gotta re-apply the same file's settings, if they changed */
+        if (changed && g_strcmp0 (proc->desktop_path, new_path) == 0 && (event_type == G_FILE_MONITOR_EVENT_CHANGED || event_type == G_FILE_MONITOR_EVENT_CREATED))
+        {
+            xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Reloading settings for process %d...", pending);
+            xfce_sandbox_process_apply_desktop_props (proc);
+            xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Done reloading settings for process %d...", pending);
+        }
+
+        /* Depending on the GAppinfo path traversal logic, the created file might
+           supersede the existing one for our sandbox, or another file might replace
+           the deleted file. Just re-add the sandbox */
+        if (event_type != G_FILE_MONITOR_EVENT_CHANGED)
+        {
+            xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Reloading process %d entirely...", pending);
+            if (xfce_sandbox_poller_remove_entry_from_pid (poller, pending))
+                xfce_sandbox_poller_add_entry_from_pid (poller, pending, NULL);
+            xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Done reloading process %d entirely...", pending);
+        }
     }
 
+    g_slist_free (pids);
+    g_free (name);
     g_free (new_path);
 }
 
@@ -1117,7 +2100,7 @@ xfce_sandbox_process_start_watching (XfceSandboxProcess *proc)
     {
       gchar    *desktop_path;
 
-      desktop_path = find_desktop_path_from_name (proc);
+      desktop_path = find_desktop_path_from_name (proc->poller, proc->name);
       if (!desktop_path)
       {
         xfsettings_dbg (XFSD_DEBUG_FIREJAIL, "Could not find the Desktop app corresponding to sandbox name %s. Not managing sandbox %d's settings.", proc->name, proc->pid);
@@ -29,6 +29,10 @@ typedef struct _XfceSandboxPoller      XfceSandboxPoller;
 #define XFCE_IS_SANDBOX_POLLER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), XFCE_TYPE_SANDBOX_POLLER))
 #define XFCE_SANDBOX_POLLER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), XFCE_TYPE_SANDBOX_POLLER, XfceSandboxPollerClass))
 
+/* metrics of the poller, GetMetrics () returns them as a{st} */
+#define XFCE_SANDBOX_POLLER_DBUS_PATH       "/org/xfce/SettingsDaemon/Firejail"
+#define XFCE_SANDBOX_POLLER_DBUS_INTERFACE  "org.xfce.SettingsDaemon.Firejail"
+
 GType xfce_sandbox_poller_get_type (void) G_GNUC_CONST;
 
 #endif /* !__FIREJAIL_SANDBOXES_H__ */
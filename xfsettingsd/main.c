@@ -74,11 +74,13 @@ static XfceSMClient *sm_client = NULL;
 static gboolean opt_version = FALSE;
 static gboolean opt_no_daemon = FALSE;
 static gboolean opt_replace = FALSE;
+static gboolean opt_firejail_metrics = FALSE;
 static GOptionEntry option_entries[] =
 {
     { "version", 'V', 0, G_OPTION_ARG_NONE, &opt_version, N_("Version information"), NULL },
     { "no-daemon", 0, 0, G_OPTION_ARG_NONE, &opt_no_daemon, N_("Do not fork to the background"), NULL },
     { "replace", 0, 0, G_OPTION_ARG_NONE, &opt_replace, N_("Replace running xsettings daemon (if any)"), NULL },
+    { "firejail-metrics", 0, 0, G_OPTION_ARG_NONE, &opt_firejail_metrics, N_("Print the sandbox metrics of the running daemon"), NULL },
     { NULL }
 };
 
@@ -94,6 +96,67 @@ signal_handler (gint signum,
 
 
 
+static gint
+print_firejail_metrics (void)
+{
+    DBusConnection  *connection;
+    DBusMessage     *message;
+    DBusMessage     *reply;
+    DBusMessageIter  iter, dict, entry;
+    DBusError        derror;
+    const gchar     *key;
+    dbus_uint64_t    value;
+
+    dbus_error_init (&derror);
+
+    connection = dbus_bus_get (DBUS_BUS_SESSION, &derror);
+    if (connection == NULL)
+    {
+        g_printerr ("%s: %s.\n", G_LOG_DOMAIN, derror.message);
+        dbus_error_free (&derror);
+        return EXIT_FAILURE;
+    }
+
+    message = dbus_message_new_method_call (XFSETTINGS_DBUS_NAME,
+                                            XFCE_SANDBOX_POLLER_DBUS_PATH,
+                                            XFCE_SANDBOX_POLLER_DBUS_INTERFACE,
+                                            "GetMetrics");
+    reply = dbus_connection_send_with_reply_and_block (connection, message, -1, &derror);
+    dbus_message_unref (message);
+
+    if (reply == NULL)
+    {
+        g_printerr ("%s: %s.\n", G_LOG_DOMAIN, derror.message);
+        dbus_error_free (&derror);
+        dbus_connection_unref (connection);
+        return EXIT_FAILURE;
+    }
+
+    /* one "name value" line per metric */
+    if (dbus_message_iter_init (reply, &iter)
+        && dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_ARRAY)
+    {
+        for (dbus_message_iter_recurse (&iter, &dict);
+             dbus_message_iter_get_arg_type (&dict) == DBUS_TYPE_DICT_ENTRY;
+             dbus_message_iter_next (&dict))
+        {
+            dbus_message_iter_recurse (&dict, &entry);
+            dbus_message_iter_get_basic (&entry, &key);
+            dbus_message_iter_next (&entry);
+            dbus_message_iter_get_basic (&entry, &value);
+
+            g_print ("%s %" G_GUINT64_FORMAT "\n", key, (guint64) value);
+        }
+    }
+
+    dbus_message_unref (reply);
+    dbus_connection_unref (connection);
+
+    return EXIT_SUCCESS;
+}
+
+
+
 static DBusHandlerResult
 dbus_connection_filter_func (DBusConnection *connection,
                              DBusMessage    *message,
@@ -177,6 +240,12 @@ main (gint argc, gchar **argv)
 
     xfce_textdomain (GETTEXT_PACKAGE, LOCALEDIR, "UTF-8");
 
+#if !GLIB_CHECK_VERSION (2, 32, 0)
+    /* the xsettings helper rescans fontconfig in a thread */
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+#endif
+
     context = g_option_context_new (NULL);
     g_option_context_add_main_entries (context, option_entries, GETTEXT_PACKAGE);
     /* We can't add the following command because it will invoke gtk_init
@@ -213,6 +282,10 @@ main (gint argc, gchar **argv)
         return EXIT_SUCCESS;
     }
 
+    /* ask the running daemon instead of starting one */
+    if (G_UNLIKELY (opt_firejail_metrics))
+        return print_firejail_metrics ();
+
     /* daemonize the process */
     if (!opt_no_daemon)
     {
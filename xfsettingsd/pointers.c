@@ -55,9 +55,14 @@
 #define DEVICE_ENABLED "Device Enabled"
 #endif /* XI_PROP_ENABLED */
 
+typedef struct _XfcePointerDevice XfcePointerDevice;
+
 static void             xfce_pointers_helper_finalize                 (GObject            *object);
 static void             xfce_pointers_helper_syndaemon_stop           (XfcePointersHelper *helper);
 static void             xfce_pointers_helper_syndaemon_check          (XfcePointersHelper *helper);
+static void             xfce_pointers_helper_device_free              (gpointer            data);
+static void             xfce_pointers_helper_add_devices              (XfcePointersHelper *helper,
+                                                                       XID                *xid);
 static void             xfce_pointers_helper_restore_devices          (XfcePointersHelper *helper,
                                                                        XID                *xid);
 static void             xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
@@ -70,8 +75,7 @@ static GdkFilterReturn  xfce_pointers_helper_event_filter             (GdkXEvent
                                                                        gpointer            user_data);
 #endif
 #if defined(DEVICE_PROPERTIES) || defined(HAVE_LIBINPUT)
-static void             xfce_pointers_helper_change_property          (XDeviceInfo        *device_info,
-                                                                       XDevice            *device,
+static void             xfce_pointers_helper_change_property          (XfcePointerDevice  *pointer,
                                                                        Display            *xdisplay,
                                                                        const gchar        *prop_name,
                                                                        const GValue       *value);
@@ -99,14 +103,47 @@ struct _XfcePointersHelper
     /* device presence event type */
     gint           device_presence_event_type;
 #endif
+
+    /* opened pointer devices, XID -> XfcePointerDevice */
+    GHashTable    *devices;
+};
+
+struct _XfcePointerDevice
+{
+    XID      id;
+    Atom     type;
+    XDevice *device;
+    gchar   *name;
+    gchar   *xfconf_name;
+    gshort   num_buttons;
+
+#ifdef HAVE_LIBINPUT
+    gboolean is_libinput;
+#endif
+
+#if defined(DEVICE_PROPERTIES) || defined(HAVE_LIBINPUT)
+    /* device properties known to the server, and properties
+     * that were still missing after listing them again */
+    Atom    *props;
+    gint     n_props;
+    GArray  *missing;
+#endif
+
+    /* pointer feedback of the device */
+    gboolean has_feedback;
+    XID      feedback_id;
+
+    /* last applied feedback, -2 if not set yet */
+    gint     threshold;
+    gdouble  acceleration;
 };
 
 typedef struct
 {
-    Display     *xdisplay;
-    XDevice     *device;
-    XDeviceInfo *device_info;
-    gsize        prop_name_len;
+    Display           *xdisplay;
+    XfcePointerDevice *pointer;
+    const gchar       *prefix;
+    gsize              prefix_len;
 }
 XfcePointerData;
 
@@ -135,6 +172,9 @@ xfce_pointers_helper_init (XfcePointersHelper *helper)
     XEventClass        event_class;
 #endif
 
+    helper->devices = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                             NULL, xfce_pointers_helper_device_free);
+
     /* get the default display */
     xdisplay = gdk_x11_display_get_xdisplay (gdk_display_get_default ());
 
@@ -163,7 +203,8 @@ xfce_pointers_helper_init (XfcePointersHelper *helper)
         /* open the channel */
         helper->channel = xfconf_channel_get ("pointers");
 
-        /* restore the pointer devices */
+        /* open and restore the pointer devices */
+        xfce_pointers_helper_add_devices (helper, NULL);
         xfce_pointers_helper_restore_devices (helper, NULL);
 
         /* monitor the channel */
@@ -196,7 +237,11 @@ xfce_pointers_helper_init (XfcePointersHelper *helper)
 static void
 xfce_pointers_helper_finalize (GObject *object)
 {
-    xfce_pointers_helper_syndaemon_stop (XFCE_POINTERS_HELPER (object));
+    XfcePointersHelper *helper = XFCE_POINTERS_HELPER (object);
+
+    xfce_pointers_helper_syndaemon_stop (helper);
+
+    g_hash_table_destroy (helper->devices);
 
     (*G_OBJECT_CLASS (xfce_pointers_helper_parent_class)->finalize) (object);
 }
@@ -259,6 +304,49 @@ xfce_pointers_is_libinput (Display *xdisplay,
 
 
 
+#if defined(DEVICE_PROPERTIES) || defined(HAVE_LIBINPUT)
+static gboolean
+xfce_pointers_helper_has_property (XfcePointerDevice *pointer,
+                                   Display           *xdisplay,
+                                   Atom               prop)
+{
+    gint  n;
+    guint i;
+
+    for (n = 0; n < pointer->n_props; n++)
+        if (pointer->props[n] == prop)
+            return TRUE;
+
+    /* don't ask the server again for a property it didn't have */
+    for (i = 0; i < pointer->missing->len; i++)
+        if (g_array_index (pointer->missing, Atom, i) == prop)
+            return FALSE;
+
+    /* drivers can add properties after the device was opened,
+     * so list them again once for each unknown property */
+    if (pointer->props != NULL)
+        XFree (pointer->props);
+
+    gdk_error_trap_push ();
+    pointer->props = XListDeviceProperties (xdisplay, pointer->device, &pointer->n_props);
+    if (gdk_error_trap_pop () != 0 || pointer->props == NULL)
+    {
+        pointer->props = NULL;
+        pointer->n_props = 0;
+    }
+
+    for (n = 0; n < pointer->n_props; n++)
+        if (pointer->props[n] == prop)
+            return TRUE;
+
+    g_array_append_val (pointer->missing, prop);
+
+    return FALSE;
+}
+#endif /* DEVICE_PROPERTIES || HAVE_LIBINPUT */
+
+
+
 static void
 xfce_pointers_helper_syndaemon_stop (XfcePointersHelper *helper)
 {
@@ -281,66 +369,37 @@ static void
 xfce_pointers_helper_syndaemon_check (XfcePointersHelper *helper)
 {
 #ifdef DEVICE_PROPERTIES
-    Display     *xdisplay = GDK_DISPLAY ();
-    XDeviceInfo *device_list;
-    XDevice     *device;
-    gint         n, ndevices;
-    Atom         touchpad_type;
-    Atom         touchpad_off_prop;
-    Atom        *props;
-    gint         i, nprops;
-    gboolean     have_synaptics = FALSE;
-    gdouble      disable_duration;
-    gchar        disable_duration_string[64];
-    gchar       *args[] = { "syndaemon", "-i", disable_duration_string, "-K", "-R", NULL };
-    GError      *error = NULL;
+    Display           *xdisplay = GDK_DISPLAY ();
+    XfcePointerDevice *pointer;
+    GHashTableIter     iter;
+    gpointer           value;
+    Atom               touchpad_type;
+    Atom               touchpad_off_prop;
+    gboolean           have_synaptics = FALSE;
+    gdouble            disable_duration;
+    gchar              disable_duration_string[64];
+    gchar             *args[] = { "syndaemon", "-i", disable_duration_string, "-K", "-R", NULL };
+    GError            *error = NULL;
 
     /* only stop a running daemon */
     if (!xfconf_channel_get_bool (helper->channel, "/DisableTouchpadWhileTyping", FALSE))
         goto start_stop_daemon;
 
-    gdk_error_trap_push ();
-    device_list = XListInputDevices (xdisplay, &ndevices);
-    if (gdk_error_trap_pop () != 0 || device_list == NULL)
-        goto start_stop_daemon;
-
     touchpad_type = XInternAtom (xdisplay, XI_TOUCHPAD, True);
     touchpad_off_prop = XInternAtom (xdisplay, "Synaptics Off", True);
+    if (touchpad_type == None || touchpad_off_prop == None)
+        goto start_stop_daemon;
 
-    for (n = 0; n < ndevices; n++)
+    g_hash_table_iter_init (&iter, helper->devices);
+    while (!have_synaptics && g_hash_table_iter_next (&iter, NULL, &value))
     {
-        /* search for a touchpad */
-        if (device_list[n].type != touchpad_type)
-            continue;
-
-        gdk_error_trap_push ();
-        device = XOpenDevice (xdisplay, device_list[n].id);
-        if (gdk_error_trap_pop () != 0 || device == NULL)
-        {
-            g_critical ("Unable to open device %s", device_list[n].name);
-            break;
-        }
-
-        /* look for the Synaptics Off property */
-        gdk_error_trap_push ();
-        props = XListDeviceProperties (xdisplay, device, &nprops);
-        if (gdk_error_trap_pop () == 0
-            && props != NULL)
-        {
-            for (i = 0; !have_synaptics && i < nprops; i++)
-                have_synaptics = props[i] == touchpad_off_prop;
-
-            XFree (props);
-        }
-
-        XCloseDevice (xdisplay, device);
-
-        if (have_synaptics)
-            break;
+        /* search for a touchpad with the Synaptics Off property */
+        pointer = value;
+        if (pointer->type == touchpad_type)
+            have_synaptics = xfce_pointers_helper_has_property (pointer, xdisplay,
+                                                                touchpad_off_prop);
     }
 
-    XFreeDeviceList (device_list);
-
     start_stop_daemon:
 
     /* stop the daemon in any case */
@@ -410,22 +469,20 @@ xfce_pointers_helper_change_button_mapping_swap (guchar   *buttonmap,
 
 
 static void
-xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
-                                            XDevice     *device,
-                                            Display     *xdisplay,
-                                            gint         right_handed,
-                                            gint         reverse_scrolling)
+xfce_pointers_helper_change_button_mapping (XfcePointerDevice *pointer,
+                                            Display           *xdisplay,
+                                            gint               right_handed,
+                                            gint               reverse_scrolling)
 {
-    XAnyClassPtr  ptr;
-    gshort        num_buttons = 0;
-    guchar       *buttonmap;
-    gboolean      map_changed = FALSE;
-    gint          n;
-    gint          right_button;
-    GString      *readable_map;
+    gshort    num_buttons = pointer->num_buttons;
+    guchar   *buttonmap;
+    gboolean  map_changed = FALSE;
+    gint      n;
+    gint      right_button;
+    GString  *readable_map;
 
 #ifdef HAVE_LIBINPUT
-    if (xfce_pointers_is_libinput (xdisplay, device))
+    if (pointer->is_libinput)
     {
         if (right_handed != -1)
         {
@@ -434,7 +491,7 @@ xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
             g_value_init (&value, G_TYPE_INT);
             g_value_set_int (&value, !right_handed);
 
-            xfce_pointers_helper_change_property (device_info, device, xdisplay,
+            xfce_pointers_helper_change_property (pointer, xdisplay,
                                                   LIBINPUT_PROP_LEFT_HANDED, &value);
         }
 
@@ -445,7 +502,7 @@ xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
             g_value_init (&value, G_TYPE_INT);
             g_value_set_int (&value, reverse_scrolling);
 
-            xfce_pointers_helper_change_property (device_info, device, xdisplay,
+            xfce_pointers_helper_change_property (pointer, xdisplay,
                                                   LIBINPUT_PROP_NATURAL_SCROLL, &value);
         }
 
@@ -453,22 +510,9 @@ xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
     }
 #endif /* HAVE_LIBINPUT */
 
-    /* search the number of buttons */
-    for (n = 0, ptr = device_info->inputclassinfo; n < device_info->num_classes; n++)
-    {
-        if (ptr->class == ButtonClass)
-        {
-            num_buttons = ((XButtonInfoPtr) ptr)->num_buttons;
-            break;
-        }
-
-        /* advance the offset */
-        ptr = (XAnyClassPtr) ((gchar *) ptr + ptr->length);
-    }
-
     if (num_buttons == 0)
     {
-        g_critical ("Device %s has no buttons", device_info->name);
+        g_critical ("Device %s has no buttons", pointer->name);
         return;
     }
 
@@ -476,7 +520,7 @@ xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
     buttonmap = g_new0 (guchar, num_buttons);
 
     gdk_error_trap_push ();
-    XGetDeviceButtonMapping (xdisplay, device, buttonmap, num_buttons);
+    XGetDeviceButtonMapping (xdisplay, pointer->device, buttonmap, num_buttons);
     if (gdk_error_trap_pop () != 0)
     {
         g_warning ("Failed to get button mapping");
@@ -512,7 +556,7 @@ xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
     if (map_changed)
     {
         gdk_error_trap_push ();
-        XSetDeviceButtonMapping (xdisplay, device, buttonmap, num_buttons);
+        XSetDeviceButtonMapping (xdisplay, pointer->device, buttonmap, num_buttons);
         if (gdk_error_trap_pop () != 0)
             g_warning ("Failed to set button mapping");
 
@@ -521,13 +565,13 @@ xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
         for (n = 0; n < num_buttons; n++)
             g_string_append_printf (readable_map, "%d ", buttonmap[n]);
         xfsettings_dbg (XFSD_DEBUG_POINTERS, "[%s] new buttonmap is [%s]",
-                        device_info->name, readable_map->str);
+                        pointer->name, readable_map->str);
         g_string_free (readable_map, TRUE);
     }
     else
     {
         xfsettings_dbg (XFSD_DEBUG_POINTERS, "[%s] buttonmap not changed",
-                        device_info->name);
+                        pointer->name);
     }
 
     leave:
@@ -548,11 +592,10 @@ xfce_pointers_helper_gcd (gint num,
 
 
 static void
-xfce_pointers_helper_change_feedback (XDeviceInfo *device_info,
-                                      XDevice     *device,
-                                      Display     *xdisplay,
-                                      gint         threshold,
-                                      gdouble      acceleration)
+xfce_pointers_helper_change_feedback (XfcePointerDevice *pointer,
+                                      Display           *xdisplay,
+                                      gint               threshold,
+                                      gdouble            acceleration)
 {
     XFeedbackState      *states, *pt;
     gint                 num_feedbacks;
@@ -560,10 +603,20 @@ xfce_pointers_helper_change_feedback (XDeviceInfo *device_info,
     gint                 n;
     gulong               mask = 0;
     gint                 num, denom, gcd;
-    gboolean             found = FALSE;
+
+    /* -2 is passed if no change is required, skip the request if
+     * the values match what was last applied to the device */
+    if ((threshold == -2 || threshold == pointer->threshold)
+        && (acceleration == -2.00 || acceleration == pointer->acceleration))
+        return;
+
+    if (threshold != -2)
+        pointer->threshold = threshold;
+    if (acceleration != -2.00)
+        pointer->acceleration = acceleration;
 
 #ifdef HAVE_LIBINPUT
-    if (xfce_pointers_is_libinput (xdisplay, device))
+    if (pointer->is_libinput)
     {
         gdouble libinput_accel;
         GValue value = G_VALUE_INIT;
@@ -572,108 +625,111 @@ xfce_pointers_helper_change_feedback (XDeviceInfo *device_info,
         g_value_init (&value, G_TYPE_DOUBLE);
         g_value_set_double (&value, libinput_accel);
 
-        xfce_pointers_helper_change_property (device_info, device, xdisplay,
+        xfce_pointers_helper_change_property (pointer, xdisplay,
                                               LIBINPUT_PROP_ACCEL, &value);
         return;
     }
 #endif /* HAVE_LIBINPUT */
-    /* get the feedback states for this device */
-    gdk_error_trap_push ();
-    states = XGetFeedbackControl (xdisplay, device, &num_feedbacks);
-    if (gdk_error_trap_pop() != 0 || states == NULL)
-    {
-        g_critical ("Failed to get the feedback states of device %s",
-                    device_info->name);
-        return;
-    }
 
-    for (pt = states, n = 0; n < num_feedbacks; n++)
+    if (!pointer->has_feedback)
     {
-        /* find the pointer feedback class */
-        if (pt->class != PtrFeedbackClass)
+        /* get the feedback states for this device */
+        gdk_error_trap_push ();
+        states = XGetFeedbackControl (xdisplay, pointer->device, &num_feedbacks);
+        if (gdk_error_trap_pop() != 0 || states == NULL)
         {
-            /* advance the offset */
-            pt = (XFeedbackState *) ((gchar *) pt + pt->length);
-            continue;
+            g_critical ("Failed to get the feedback states of device %s",
+                        pointer->name);
+            return;
         }
 
-        /* initialize the feedback, -1 for reset if the
-         * mask matches in XChangeFeedbackControl */
-        feedback.class = PtrFeedbackClass;
-        feedback.length = sizeof (XPtrFeedbackControl);
-        feedback.id = pt->id;
-        feedback.threshold = -1;
-        feedback.accelNum = -1;
-        feedback.accelDenom = -1;
-
-        found = TRUE;
-
-        /* above 0 is a valid value, -1 is reset, -2.00
-         * is passed if no change is required */
-        if (acceleration >= 0 || acceleration == -1)
+        for (pt = states, n = 0; n < num_feedbacks; n++)
         {
-            if (acceleration >= 0)
+            /* find the pointer feedback class */
+            if (pt->class == PtrFeedbackClass)
             {
-                /* calculate the faction of the acceleration */
-                num = acceleration * MAX_DENOMINATOR;
-                denom = MAX_DENOMINATOR;
-                gcd = xfce_pointers_helper_gcd (num, denom);
-                num /= gcd;
-                denom /= gcd;
-
-                feedback.accelNum = num;
-                feedback.accelDenom = denom;
+                pointer->feedback_id = pt->id;
+                pointer->has_feedback = TRUE;
+                break;
             }
 
-            /* include acceleration in the mask */
-            mask |= DvAccelNum | DvAccelDenom;
+            /* advance the offset */
+            pt = (XFeedbackState *) ((gchar *) pt + pt->length);
         }
 
-        /* above 0 is a valid value, -1 is reset, -2 is
-         * passed if no change is required */
-        if (threshold > 0 || threshold == -1)
-        {
-            if (threshold > 0)
-                feedback.threshold = threshold;
+        XFreeFeedbackList (states);
 
-            mask |= DvThreshold;
+        if (!pointer->has_feedback)
+        {
+            g_critical ("Unable to find PtrFeedbackClass for %s",
+                        pointer->name);
+            return;
         }
+    }
 
-        /* update the feedback of the device */
-        gdk_error_trap_push ();
-        XChangeFeedbackControl (xdisplay, device, mask,
-                                (XFeedbackControl *) &feedback);
-        if (gdk_error_trap_pop() != 0)
+    /* initialize the feedback, -1 for reset if the
+     * mask matches in XChangeFeedbackControl */
+    feedback.class = PtrFeedbackClass;
+    feedback.length = sizeof (XPtrFeedbackControl);
+    feedback.id = pointer->feedback_id;
+    feedback.threshold = -1;
+    feedback.accelNum = -1;
+    feedback.accelDenom = -1;
+
+    /* above 0 is a valid value, -1 is reset, -2.00
+     * is passed if no change is required */
+    if (acceleration >= 0 || acceleration == -1)
+    {
+        if (acceleration >= 0)
         {
-            g_warning ("Failed to set feedback states for device %s",
-                       device_info->name);
+            /* calculate the faction of the acceleration */
+            num = acceleration * MAX_DENOMINATOR;
+            denom = MAX_DENOMINATOR;
+            gcd = xfce_pointers_helper_gcd (num, denom);
+            num /= gcd;
+            denom /= gcd;
+
+            feedback.accelNum = num;
+            feedback.accelDenom = denom;
         }
 
-        xfsettings_dbg (XFSD_DEBUG_POINTERS,
-                        "[%s] change feedback (threshold=%d, "
-                        "accelNum=%d, accelDenom=%d)",
-                        device_info->name, feedback.threshold,
-                        feedback.accelNum, feedback.accelDenom);
+        /* include acceleration in the mask */
+        mask |= DvAccelNum | DvAccelDenom;
+    }
+
+    /* above 0 is a valid value, -1 is reset, -2 is
+     * passed if no change is required */
+    if (threshold > 0 || threshold == -1)
+    {
+        if (threshold > 0)
+            feedback.threshold = threshold;
 
-        break;
+        mask |= DvThreshold;
     }
 
-    if (!found)
+    /* update the feedback of the device */
+    gdk_error_trap_push ();
+    XChangeFeedbackControl (xdisplay, pointer->device, mask,
+                            (XFeedbackControl *) &feedback);
+    if (gdk_error_trap_pop() != 0)
     {
-        g_critical ("Unable to find PtrFeedbackClass for %s",
-                    device_info->name);
+        g_warning ("Failed to set feedback states for device %s",
+                   pointer->name);
     }
 
-    XFreeFeedbackList (states);
+    xfsettings_dbg (XFSD_DEBUG_POINTERS,
+                    "[%s] change feedback (threshold=%d, "
+                    "accelNum=%d, accelDenom=%d)",
+                    pointer->name, feedback.threshold,
+                    feedback.accelNum, feedback.accelDenom);
 }
 
 
 
 static void
-xfce_pointers_helper_change_mode (XDeviceInfo  *device_info,
-                                  XDevice      *device,
-                                  Display      *xdisplay,
-                                  const gchar  *mode_name)
+xfce_pointers_helper_change_mode (XfcePointerDevice *pointer,
+                                  Display           *xdisplay,
+                                  const gchar       *mode_name)
 {
     gint mode;
 
@@ -688,12 +744,12 @@ xfce_pointers_helper_change_mode (XDeviceInfo  *device_info,
     }
 
     gdk_error_trap_push ();
-    XSetDeviceMode (xdisplay, device, mode);
+    XSetDeviceMode (xdisplay, pointer->device, mode);
     if (gdk_error_trap_pop () != 0)
         g_critical ("Failed to change the device mode");
 
     xfsettings_dbg (XFSD_DEBUG_POINTERS,
-                    "[%s] Set mode to %s", device_info->name, mode_name);
+                    "[%s] Set mode to %s", pointer->name, mode_name);
 }
 
 
@@ -732,16 +788,128 @@ xfce_pointers_helper_device_xfconf_name (const gchar *name)
 
 
 
+static void
+xfce_pointers_helper_device_free (gpointer data)
+{
+    XfcePointerDevice *pointer = data;
+
+    /* the device might already be gone on the server */
+    gdk_error_trap_push ();
+    XCloseDevice (GDK_DISPLAY (), pointer->device);
+    gdk_error_trap_pop ();
+
+#if defined(DEVICE_PROPERTIES) || defined(HAVE_LIBINPUT)
+    if (pointer->props != NULL)
+        XFree (pointer->props);
+    g_array_free (pointer->missing, TRUE);
+#endif
+
+    g_free (pointer->name);
+    g_free (pointer->xfconf_name);
+
+    g_slice_free (XfcePointerDevice, pointer);
+}
+
+
+
+static void
+xfce_pointers_helper_add_devices (XfcePointersHelper *helper,
+                                  XID                *xid)
+{
+    Display           *xdisplay = GDK_DISPLAY ();
+    XDeviceInfo       *device_list, *device_info;
+    gint               n, i, ndevices;
+    XDevice           *device;
+    XAnyClassPtr       ptr;
+    XfcePointerDevice *pointer;
+
+    gdk_error_trap_push ();
+    device_list = XListInputDevices (xdisplay, &ndevices);
+    if (gdk_error_trap_pop () != 0 || device_list == NULL)
+    {
+        g_message ("No input devices found");
+        return;
+    }
+
+    for (n = 0; n < ndevices; n++)
+    {
+        /* filter the pointer devices */
+        device_info = &device_list[n];
+        if (device_info->use != IsXExtensionPointer
+            || device_info->name == NULL)
+            continue;
+
+        /* filter out the device if one is set */
+        if (xid != NULL && device_info->id != *xid)
+            continue;
+
+        /* open the device */
+        gdk_error_trap_push ();
+        device = XOpenDevice (xdisplay, device_info->id);
+        if (gdk_error_trap_pop () != 0 || device == NULL)
+        {
+            g_critical ("Unable to open device %s", device_info->name);
+            continue;
+        }
+
+        pointer = g_slice_new0 (XfcePointerDevice);
+        pointer->id = device_info->id;
+        pointer->type = device_info->type;
+        pointer->device = device;
+        pointer->name = g_strdup (device_info->name);
+        pointer->threshold = -2;
+        pointer->acceleration = -2.00;
+
+        /* create a valid xfconf property name for the device */
+        pointer->xfconf_name = xfce_pointers_helper_device_xfconf_name (device_info->name);
+
+        /* search the number of buttons */
+        for (i = 0, ptr = device_info->inputclassinfo; i < device_info->num_classes; i++)
+        {
+            if (ptr->class == ButtonClass)
+            {
+                pointer->num_buttons = ((XButtonInfoPtr) ptr)->num_buttons;
+                break;
+            }
+
+            /* advance the offset */
+            ptr = (XAnyClassPtr) ((gchar *) ptr + ptr->length);
+        }
+
+#if defined(DEVICE_PROPERTIES) || defined(HAVE_LIBINPUT)
+        gdk_error_trap_push ();
+        pointer->props = XListDeviceProperties (xdisplay, device, &pointer->n_props);
+        if (gdk_error_trap_pop () != 0 || pointer->props == NULL)
+        {
+            pointer->props = NULL;
+            pointer->n_props = 0;
+        }
+        pointer->missing = g_array_new (FALSE, FALSE, sizeof (Atom));
+#endif
+
+#ifdef HAVE_LIBINPUT
+        pointer->is_libinput = xfce_pointers_is_libinput (xdisplay, device);
+#endif
+
+        xfsettings_dbg (XFSD_DEBUG_POINTERS, "[%s] opened device %d (%s)",
+                        pointer->name, (gint) pointer->id, pointer->xfconf_name);
+
+        /* replaces a stale entry if the server reused the id */
+        g_hash_table_replace (helper->devices, GUINT_TO_POINTER (pointer->id), pointer);
+    }
+
+    XFreeDeviceList (device_list);
+}
+
+
+
 #if defined(DEVICE_PROPERTIES) || defined(HAVE_LIBINPUT)
 static void
-xfce_pointers_helper_change_property (XDeviceInfo  *device_info,
-                                      XDevice      *device,
-                                      Display      *xdisplay,
-                                      const gchar  *prop_name,
-                                      const GValue *value)
+xfce_pointers_helper_change_property (XfcePointerDevice *pointer,
+                                      Display           *xdisplay,
+                                      const gchar       *prop_name,
+                                      const GValue      *value)
 {
-    Atom         *props;
-    gint          n, n_props;
     Atom          prop;
     gchar        *atom_name;
     Atom          type;
@@ -778,128 +946,118 @@ xfce_pointers_helper_change_property (XDeviceInfo  *device_info,
      * and: http://lists.x.org/archives/xorg-devel/2015-February/045716.html
      */
     if (prop != XInternAtom (xdisplay, DEVICE_ENABLED, True) &&
-        !xfce_pointers_is_enabled (xdisplay, device))
+        !xfce_pointers_is_enabled (xdisplay, pointer->device))
         return;
 #endif /* HAVE_LIBINPUT */
 
+    /* only query devices that actually have the property */
+    if (!xfce_pointers_helper_has_property (pointer, xdisplay, prop))
+        return;
+
     gdk_error_trap_push ();
-    props = XListDeviceProperties (xdisplay, device, &n_props);
-    if (gdk_error_trap_pop () || props == NULL)
+    rc = XGetDeviceProperty (xdisplay, pointer->device, prop, 0, 1000, False,
+                             AnyPropertyType, &type, &format,
+                             &n_items, &bytes_after, &data.c);
+    if (gdk_error_trap_pop () || rc != Success)
         return;
 
     float_atom = XInternAtom (xdisplay, "FLOAT", False);
 
-    for (n = 0; n < n_props; n++)
+    if (n_items == 1
+        && (G_VALUE_HOLDS_INT (value)
+            || G_VALUE_HOLDS_STRING (value)
+            || G_VALUE_HOLDS_DOUBLE (value)))
     {
-        /* find the matching property */
-        if (props[n] != prop)
-            continue;
+        /* only 1 items to set */
+        val = value;
+    }
+    else if (G_VALUE_TYPE (value) == XFCONF_TYPE_G_VALUE_ARRAY)
+    {
+        array = g_value_get_boxed (value);
+        if (array->len != n_items)
+        {
+            g_critical ("Nr device property items (%ld) and xfconf value (%d) differ",
+                        n_items, array->len);
+            goto leave;
+        }
+    }
+    else
+    {
+        g_critical ("Invalid device property combination");
+        goto leave;
+    }
 
-        gdk_error_trap_push ();
-        rc = XGetDeviceProperty (xdisplay, device, prop, 0, 1000, False,
-                                 AnyPropertyType, &type, &format,
-                                 &n_items, &bytes_after, &data.c);
-        if (!gdk_error_trap_pop () && rc == Success)
+    /* reset check counter */
+    n_succeeds = 0;
+
+    for (i = 0; i < n_items; i++)
+    {
+        /* get value from pointer array */
+        if (array != NULL)
+            val = g_ptr_array_index (array, i);
+        else
+            val = value;
+
+        if (G_VALUE_HOLDS_INT (val)
+            && type == XA_INTEGER)
         {
-            if (n_items == 1
-                && (G_VALUE_HOLDS_INT (value)
-                    || G_VALUE_HOLDS_STRING (value)
-                    || G_VALUE_HOLDS_DOUBLE (value)))
-            {
-                /* only 1 items to set */
-                val = value;
-            }
-            else if (G_VALUE_TYPE (value) == XFCONF_TYPE_G_VALUE_ARRAY)
-            {
-                array = g_value_get_boxed (value);
-                if (array->len != n_items)
-                {
-                    g_critical ("Nr device property items (%ld) and xfconf value (%d) differ",
-                                n_items, array->len);
-                    break;
-                }
-            }
+            if (format == 8)
+                data.c[i] = g_value_get_int (val);
+            else if (format == 16)
+                data.s[i] = g_value_get_int (val);
+            else if (format == 32)
+                data.l[i] = g_value_get_int (val);
             else
             {
-                g_critical ("Invalid device property combination");
+                g_critical ("Unknown format %d for integer", format);
                 break;
             }
+        }
+        else if (G_VALUE_HOLDS_STRING (val)
+                 && type == XA_ATOM
+                 && format == 32)
+        {
+            /* set atom (reference to a string) */
+            data.a[i] = XInternAtom (xdisplay, g_value_get_string (val), False);
+        }
+        else if (G_VALUE_HOLDS_DOUBLE (val) /* xfconf doesn't support floats */
+                 && type == float_atom
+                 && format == 32)
+        {
+            data.f[i] = (float) g_value_get_double (val);
+        }
+        else
+        {
+            g_critical ("Unknown property type %s: target = %s, format = %d",
+                        G_VALUE_TYPE_NAME (val), XGetAtomName (xdisplay, type), format);
+            break;
+        }
 
-            /* reset check counter */
-            n_succeeds = 0;
-
-            for (i = 0; i < n_items; i++)
-            {
-                /* get value from pointer array */
-                if (array != NULL)
-                    val = g_ptr_array_index (array, i);
-                else
-                    val = value;
-
-                if (G_VALUE_HOLDS_INT (val)
-                    && type == XA_INTEGER)
-                {
-                    if (format == 8)
-                        data.c[i] = g_value_get_int (val);
-                    else if (format == 16)
-                        data.s[i] = g_value_get_int (val);
-                    else if (format == 32)
-                        data.l[i] = g_value_get_int (val);
-                    else
-                    {
-                        g_critical ("Unknown format %d for integer", format);
-                        break;
-                    }
-                }
-                else if (G_VALUE_HOLDS_STRING (val)
-                         && type == XA_ATOM
-                         && format == 32)
-                {
-                    /* set atom (reference to a string) */
-                    data.a[i] = XInternAtom (xdisplay, g_value_get_string (val), False);
-                }
-                else if (G_VALUE_HOLDS_DOUBLE (val) /* xfconf doesn't support floats */
-                         && type == float_atom
-                         && format == 32)
-                {
-                    data.f[i] = (float) g_value_get_double (val);
-                }
-                else
-                {
-                    g_critical ("Unknown property type %s: target = %s, format = %d",
-                                G_VALUE_TYPE_NAME (val), XGetAtomName (xdisplay, type), format);
-                    break;
-                }
-
-                /* the item was successfully updated */
-                n_succeeds++;
-            }
+        /* the item was successfully updated */
+        n_succeeds++;
+    }
 
-            if (n_succeeds == n_items)
-            {
-                gdk_error_trap_push ();
-                XChangeDeviceProperty (xdisplay, device, prop, type, format,
-                                       PropModeReplace, data.c, n_items);
-                XSync (xdisplay, FALSE);
-                if (gdk_error_trap_pop ())
-                {
-                    g_critical ("Failed to set device property %s for %s",
-                                prop_name, device_info->name);
-                }
-
-                xfsettings_dbg (XFSD_DEBUG_POINTERS,
-                                "[%s] Changed device property %s",
-                                device_info->name, prop_name);
-            }
+    if (n_succeeds == n_items)
+    {
+        gdk_error_trap_push ();
+        XChangeDeviceProperty (xdisplay, pointer->device, prop, type, format,
+                               PropModeReplace, data.c, n_items);
+        XSync (xdisplay, FALSE);
+        if (gdk_error_trap_pop ())
+        {
+            g_critical ("Failed to set device property %s for %s",
+                        prop_name, pointer->name);
         }
 
-        if (data.c)
-            XFree (data.c);
-
-        break;
+        xfsettings_dbg (XFSD_DEBUG_POINTERS,
+                        "[%s] Changed device property %s",
+                        pointer->name, prop_name);
     }
 
-    XFree (props);
+    leave:
+
+    if (data.c)
+        XFree (data.c);
 }
 #endif /* DEVICE_PROPERTIES || HAVE_LIBINPUT */
 
@@ -911,125 +1069,115 @@ xfce_pointers_helper_change_properties (gpointer key,
                                         gpointer user_data)
 {
     XfcePointerData *pointer_data = user_data;
-    const gchar     *prop_name = ((gchar *) key) + pointer_data->prop_name_len;
 
-    xfce_pointers_helper_change_property (pointer_data->device_info,
-                                          pointer_data->device,
+    /* only handle the device properties */
+    if (strncmp (key, pointer_data->prefix, pointer_data->prefix_len) != 0)
+        return;
+
+    xfce_pointers_helper_change_property (pointer_data->pointer,
                                           pointer_data->xdisplay,
-                                          prop_name, value);
+                                          ((gchar *) key) + pointer_data->prefix_len,
+                                          value);
 }
 #endif
 
 
 
 static void
-xfce_pointers_helper_restore_devices (XfcePointersHelper *helper,
-                                      XID                *xid)
+xfce_pointers_helper_restore_device (XfcePointersHelper *helper,
+                                     XfcePointerDevice  *pointer)
 {
     Display         *xdisplay = GDK_DISPLAY ();
-    XDeviceInfo     *device_list, *device_info;
-    gint             n, ndevices;
-    XDevice         *device;
-    gchar           *device_name;
+    GHashTable      *props;
+    const GValue    *value;
     gchar            prop[256];
-    gboolean         right_handed;
-    gboolean         reverse_scrolling;
+    gint             right_handed;
+    gint             reverse_scrolling;
     gint             threshold;
     gdouble          acceleration;
 #ifdef DEVICE_PROPERTIES
-    GHashTable      *props;
     XfcePointerData  pointer_data;
 #endif
-    const gchar     *mode;
 
-    gdk_error_trap_push ();
-    device_list = XListInputDevices (xdisplay, &ndevices);
-    if (gdk_error_trap_pop () != 0 || device_list == NULL)
-    {
-        g_message ("No input devices found");
+    /* fetch all the device settings in one go */
+    g_snprintf (prop, sizeof (prop), "/%s", pointer->xfconf_name);
+    props = xfconf_channel_get_properties (helper->channel, prop);
+    if (props == NULL)
         return;
-    }
 
-    for (n = 0; n < ndevices; n++)
-    {
-        /* filter the pointer devices */
-        device_info = &device_list[n];
-        if (device_info->use != IsXExtensionPointer
-            || device_info->name == NULL)
-            continue;
+    /* read buttonmap properties */
+    g_snprintf (prop, sizeof (prop), "/%s/RightHanded", pointer->xfconf_name);
+    value = g_hash_table_lookup (props, prop);
+    right_handed = value != NULL && G_VALUE_HOLDS_BOOLEAN (value) ? g_value_get_boolean (value) : -1;
 
-        /* filter out the device if one is set */
-        if (xid != NULL && device_info->id != *xid)
-            continue;
+    g_snprintf (prop, sizeof (prop), "/%s/ReverseScrolling", pointer->xfconf_name);
+    value = g_hash_table_lookup (props, prop);
+    reverse_scrolling = value != NULL && G_VALUE_HOLDS_BOOLEAN (value) ? g_value_get_boolean (value) : -1;
 
-        /* open the device */
-        gdk_error_trap_push ();
-        device = XOpenDevice (xdisplay, device_info->id);
-        if (gdk_error_trap_pop () != 0 || device == NULL)
-        {
-            g_critical ("Unable to open device %s", device_info->name);
-            continue;
-        }
+    if (right_handed != -1 || reverse_scrolling != -1)
+    {
+        xfce_pointers_helper_change_button_mapping (pointer, xdisplay,
+                                                    right_handed, reverse_scrolling);
+    }
 
-        /* create a valid xfconf property name for the device */
-        device_name = xfce_pointers_helper_device_xfconf_name (device_info->name);
+    /* read feedback settings */
+    g_snprintf (prop, sizeof (prop), "/%s/Threshold", pointer->xfconf_name);
+    value = g_hash_table_lookup (props, prop);
+    threshold = value != NULL && G_VALUE_HOLDS_INT (value) ? g_value_get_int (value) : -1;
 
-        /* read buttonmap properties */
-        g_snprintf (prop, sizeof (prop), "/%s/RightHanded", device_name);
-        right_handed = xfconf_channel_get_bool (helper->channel, prop, -1);
+    g_snprintf (prop, sizeof (prop), "/%s/Acceleration", pointer->xfconf_name);
+    value = g_hash_table_lookup (props, prop);
+    acceleration = value != NULL && G_VALUE_HOLDS_DOUBLE (value) ? g_value_get_double (value) : -1.00;
 
-        g_snprintf (prop, sizeof (prop), "/%s/ReverseScrolling", device_name);
-        reverse_scrolling = xfconf_channel_get_bool (helper->channel, prop, -1);
+    if (threshold != -1 || acceleration != -1.00)
+    {
+        xfce_pointers_helper_change_feedback (pointer, xdisplay,
+                                              threshold, acceleration);
+    }
 
-        if (right_handed != -1 || reverse_scrolling != -1)
-        {
-            xfce_pointers_helper_change_button_mapping (device_info, device, xdisplay,
-                                                        right_handed, reverse_scrolling);
-        }
+    /* read mode settings */
+    g_snprintf (prop, sizeof (prop), "/%s/Mode", pointer->xfconf_name);
+    value = g_hash_table_lookup (props, prop);
 
-        /* read feedback settings */
-        g_snprintf (prop, sizeof (prop), "/%s/Threshold", device_name);
-        threshold = xfconf_channel_get_int (helper->channel, prop, -1);
+    if (value != NULL && G_VALUE_HOLDS_STRING (value))
+        xfce_pointers_helper_change_mode (pointer, xdisplay, g_value_get_string (value));
 
-        g_snprintf (prop, sizeof (prop), "/%s/Acceleration", device_name);
-        acceleration = xfconf_channel_get_double (helper->channel, prop, -1.00);
+#ifdef DEVICE_PROPERTIES
+    /* set device properties */
+    g_snprintf (prop, sizeof (prop), "/%s/Properties/", pointer->xfconf_name);
 
-        if (threshold != -1 || acceleration != -1.00)
-        {
-            xfce_pointers_helper_change_feedback (device_info, device, xdisplay,
-                                                  threshold, acceleration);
-        }
+    pointer_data.xdisplay = xdisplay;
+    pointer_data.pointer = pointer;
+    pointer_data.prefix = prop;
+    pointer_data.prefix_len = strlen (prop);
 
-        /* read mode settings */
-        g_snprintf (prop, sizeof (prop), "/%s/Mode", device_name);
-        mode =  xfconf_channel_get_string  (helper->channel, prop, NULL);
+    g_hash_table_foreach (props, xfce_pointers_helper_change_properties, &pointer_data);
+#endif
 
-        if (mode != NULL)
-            xfce_pointers_helper_change_mode (device_info, device, xdisplay, mode);
+    g_hash_table_destroy (props);
+}
 
-#ifdef DEVICE_PROPERTIES
-        /* set device properties */
-        g_snprintf (prop, sizeof (prop), "/%s/Properties", device_name);
-        props = xfconf_channel_get_properties (helper->channel, prop);
 
-        if (props != NULL)
-        {
-            pointer_data.xdisplay = xdisplay;
-            pointer_data.device = device;
-            pointer_data.device_info = device_info;
-            pointer_data.prop_name_len = strlen (prop) + 1;
 
-            g_hash_table_foreach (props, xfce_pointers_helper_change_properties, &pointer_data);
-
-            g_hash_table_destroy (props);
-        }
-#endif
+static void
+xfce_pointers_helper_restore_devices (XfcePointersHelper *helper,
+                                      XID                *xid)
+{
+    XfcePointerDevice *pointer;
+    GHashTableIter     iter;
+    gpointer           value;
 
-        g_free (device_name);
-        XCloseDevice (xdisplay, device);
+    if (xid != NULL)
+    {
+        pointer = g_hash_table_lookup (helper->devices, GUINT_TO_POINTER (*xid));
+        if (pointer != NULL)
+            xfce_pointers_helper_restore_device (helper, pointer);
+        return;
     }
 
-    XFreeDeviceList (device_list);
+    g_hash_table_iter_init (&iter, helper->devices);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+        xfce_pointers_helper_restore_device (helper, value);
 }
 
 
@@ -1040,12 +1188,11 @@ xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
                                                const GValue       *value,
                                                XfcePointersHelper *helper)
 {
-    Display      *xdisplay = GDK_DISPLAY ();
-    XDeviceInfo  *device_list, *device_info;
-    XDevice      *device;
-    gint          n, ndevices;
-    gchar       **names;
-    gchar        *device_name;
+    Display            *xdisplay = GDK_DISPLAY ();
+    XfcePointerDevice  *pointer;
+    GHashTableIter      iter;
+    gpointer            data;
+    gchar             **names;
 
     if (G_UNLIKELY (property_name == NULL))
          return;
@@ -1063,84 +1210,53 @@ xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
 
     if (names != NULL && g_strv_length (names) >= 2)
     {
-        gdk_error_trap_push ();
-        device_list = XListInputDevices (xdisplay, &ndevices);
-        if (gdk_error_trap_pop () != 0 || device_list == NULL)
+        g_hash_table_iter_init (&iter, helper->devices);
+        while (g_hash_table_iter_next (&iter, NULL, &data))
         {
-            g_message ("No input devices found");
-            return;
-        }
-
-        for (n = 0; n < ndevices; n++)
-        {
-            /* filter the pointer devices */
-            device_info = &device_list[n];
-            if (device_info->use != IsXExtensionPointer
-                || device_info->name == NULL)
+            /* search the device name */
+            pointer = data;
+            if (strcmp (names[0], pointer->xfconf_name) != 0)
                 continue;
 
-            /* search the device name */
-            device_name = xfce_pointers_helper_device_xfconf_name (device_info->name);
-            if (strcmp (names[0], device_name) == 0)
+            /* check the property that requires updating */
+            if (strcmp (names[1], "RightHanded") == 0)
+            {
+                xfce_pointers_helper_change_button_mapping (pointer, xdisplay,
+                                                            g_value_get_boolean (value), -1);
+            }
+            else if (strcmp (names[1], "ReverseScrolling") == 0)
+            {
+                xfce_pointers_helper_change_button_mapping (pointer, xdisplay,
+                                                            -1, g_value_get_boolean (value));
+            }
+            else if (strcmp (names[1], "Threshold") == 0)
+            {
+                xfce_pointers_helper_change_feedback (pointer, xdisplay,
+                                                      g_value_get_int (value), -2.00);
+            }
+            else if (strcmp (names[1], "Acceleration") == 0)
             {
-                /* open the device */
-                gdk_error_trap_push ();
-                device = XOpenDevice (xdisplay, device_info->id);
-                if (gdk_error_trap_pop () != 0 || device == NULL)
-                {
-                    g_critical ("Unable to open device %s", device_info->name);
-                    continue;
-                }
-
-                /* check the property that requires updating */
-                if (strcmp (names[1], "RightHanded") == 0)
-                {
-                    xfce_pointers_helper_change_button_mapping (device_info, device, xdisplay,
-                                                                g_value_get_boolean (value), -1);
-                }
-                else if (strcmp (names[1], "ReverseScrolling") == 0)
-                {
-                    xfce_pointers_helper_change_button_mapping (device_info, device, xdisplay,
-                                                                -1, g_value_get_boolean (value));
-                }
-                else if (strcmp (names[1], "Threshold") == 0)
-                {
-                    xfce_pointers_helper_change_feedback (device_info, device, xdisplay,
-                                                          g_value_get_int (value), -2.00);
-                }
-                else if (strcmp (names[1], "Acceleration") == 0)
-                {
-                    xfce_pointers_helper_change_feedback (device_info, device, xdisplay,
-                                                          -2, g_value_get_double (value));
-                }
+                xfce_pointers_helper_change_feedback (pointer, xdisplay,
+                                                      -2, g_value_get_double (value));
+            }
 #ifdef DEVICE_PROPERTIES
-                else if (strcmp (names[1], "Properties") == 0)
-                {
-                    xfce_pointers_helper_change_property (device_info, device, xdisplay,
-                                                          names[2], value);
-                }
+            else if (strcmp (names[1], "Properties") == 0)
+            {
+                xfce_pointers_helper_change_property (pointer, xdisplay,
+                                                      names[2], value);
+            }
 #endif
-                else if (strcmp (names[1], "Mode") == 0)
-                {
-                    xfce_pointers_helper_change_mode (device_info, device, xdisplay,
-                                                      g_value_get_string (value));
-                }
-                else
-                {
-                    g_warning ("Unknown property %s set for device %s",
-                               property_name, device_info->name);
-                }
-
-                XCloseDevice (xdisplay, device);
-
-                /* stop searching */
-                n = ndevices;
+            else if (strcmp (names[1], "Mode") == 0)
+            {
+                xfce_pointers_helper_change_mode (pointer, xdisplay,
+                                                  g_value_get_string (value));
+            }
+            else
+            {
+                g_warning ("Unknown property %s set for device %s",
+                           property_name, pointer->name);
             }
-
-            g_free (device_name);
         }
-
-        XFreeDeviceList (device_list);
     }
 
     g_strfreev (names);
@@ -1160,9 +1276,17 @@ xfce_pointers_helper_event_filter (GdkXEvent *xevent,
 
     if (event->type == helper->device_presence_event_type)
     {
-        /* restore device settings */
         if (dpn_event->devchange == DeviceAdded)
+        {
+            /* open the device and restore its settings */
+            xfce_pointers_helper_add_devices (helper, &dpn_event->deviceid);
             xfce_pointers_helper_restore_devices (helper, &dpn_event->deviceid);
+        }
+        else if (dpn_event->devchange == DeviceRemoved)
+        {
+            /* close the device */
+            g_hash_table_remove (helper->devices, GUINT_TO_POINTER (dpn_event->deviceid));
+        }
 
         /* check if we need to launch syndaemon */
         xfce_pointers_helper_syndaemon_check (helper);
@@ -47,7 +47,8 @@ static guint            xfce_workspaces_helper_get_count    (void);
 static GdkFilterReturn  xfce_workspaces_helper_filter_func  (GdkXEvent            *gdkxevent,
                                                              GdkEvent             *event,
                                                              gpointer              user_data);
-static GPtrArray       *xfce_workspaces_helper_get_names    (void);
+static gboolean         xfce_workspaces_helper_read_desktop_names (XfceWorkspacesHelper *helper);
+static GPtrArray       *xfce_workspaces_helper_get_names    (XfceWorkspacesHelper *helper);
 static void             xfce_workspaces_helper_set_names    (XfceWorkspacesHelper *helper,
                                                              gboolean              disable_wm_check);
 static void             xfce_workspaces_helper_save_names   (XfceWorkspacesHelper *helper);
@@ -64,7 +65,16 @@ struct _XfceWorkspacesHelper
 
     XfconfChannel *channel;
 
-    GTimeVal       timestamp;
+    /* cached copy of the xfconf names array, refreshed when the
+     * property changes in the channel */
+    GPtrArray     *names;
+
+    /* raw contents of _NET_DESKTOP_NAMES as we last wrote or read it,
+     * used to recognize the notifications of our own changes */
+    GString       *desktop_names;
+
+    /* last workspace count stored in xfconf */
+    guint          n_workspaces;
 
 #ifdef GDK_WINDOWING_X11
     guint          wait_for_wm_timeout_id;
@@ -129,6 +139,8 @@ xfce_workspaces_helper_init (XfceWorkspacesHelper *helper)
     gdk_window_set_events (root_window, events | GDK_PROPERTY_CHANGE_MASK);
     gdk_window_add_filter (root_window, xfce_workspaces_helper_filter_func, helper);
 
+    helper->names = xfconf_channel_get_arrayv (helper->channel, WORKSPACE_NAMES_PROP);
+
     xfce_workspaces_helper_set_names (helper, FALSE);
 
     g_signal_connect (G_OBJECT(helper->channel),
@@ -147,6 +159,11 @@ xfce_workspaces_helper_finalize (GObject *object)
                                          G_CALLBACK (xfce_workspaces_helper_prop_changed),
                                          helper);
 
+    if (helper->names != NULL)
+        xfconf_array_free (helper->names);
+    if (helper->desktop_names != NULL)
+        g_string_free (helper->desktop_names, TRUE);
+
     G_OBJECT_CLASS (xfce_workspaces_helper_parent_class)->finalize (object);
 }
 
@@ -160,7 +177,6 @@ xfce_workspaces_helper_filter_func (GdkXEvent  *gdkxevent,
 #ifdef GDK_WINDOWING_X11
     XfceWorkspacesHelper  *helper = XFCE_WORKSPACES_HELPER (user_data);
     XEvent                *xevent = gdkxevent;
-    GTimeVal               timestamp;
 
     if (xevent->type == PropertyNotify)
     {
@@ -173,11 +189,9 @@ xfce_workspaces_helper_filter_func (GdkXEvent  *gdkxevent,
         }
         else if (xevent->xproperty.atom == atom_net_desktop_names)
         {
-            /* don't respond to our own name changes (1 sec) */
-            g_get_current_time (&timestamp);
-            if (timestamp.tv_sec > helper->timestamp.tv_sec
-                || (timestamp.tv_sec == helper->timestamp.tv_sec
-                    && timestamp.tv_usec > helper->timestamp.tv_usec))
+            /* don't respond to our own name changes, the property
+             * then still holds what we wrote */
+            if (xfce_workspaces_helper_read_desktop_names (helper))
             {
                 /* someone changed (possibly another application that does
                  * not update xfconf) the name of a desktop, store the
@@ -186,6 +200,10 @@ xfce_workspaces_helper_filter_func (GdkXEvent  *gdkxevent,
 
                 xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "someone else changed the desktop names");
             }
+            else
+            {
+                xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "ignored our own desktop names change");
+            }
         }
     }
 #endif
@@ -195,16 +213,14 @@ xfce_workspaces_helper_filter_func (GdkXEvent  *gdkxevent,
 
 
 
-static GPtrArray *
-xfce_workspaces_helper_get_names (void)
+static gboolean
+xfce_workspaces_helper_read_desktop_names (XfceWorkspacesHelper *helper)
 {
     gboolean     succeed;
     GdkAtom      utf8_atom, type_returned;
-    gint         i, length, num;
-    GPtrArray   *names = NULL;
+    gint         length;
     gchar       *data = NULL;
-    GValue      *val;
-    const gchar *p;
+    gboolean     changed;
 
     gdk_error_trap_push ();
 
@@ -216,11 +232,50 @@ xfce_workspaces_helper_get_names (void)
                                 FALSE, &type_returned, NULL, &length,
                                 (guchar **) &data);
 
-    if (gdk_error_trap_pop () == 0
-        && succeed
-        && type_returned == utf8_atom
-        && data != NULL
-        && length > 0)
+    if (gdk_error_trap_pop () != 0
+        || !succeed
+        || type_returned != utf8_atom
+        || data == NULL)
+        length = 0;
+
+    /* compare with the contents we last wrote or read */
+    changed = helper->desktop_names == NULL
+              || helper->desktop_names->len != (gsize) length
+              || (length > 0 && memcmp (helper->desktop_names->str, data, length) != 0);
+
+    if (changed)
+    {
+        if (helper->desktop_names == NULL)
+            helper->desktop_names = g_string_new (NULL);
+        else
+            g_string_truncate (helper->desktop_names, 0);
+
+        if (length > 0)
+            g_string_append_len (helper->desktop_names, data, length);
+    }
+
+    g_free (data);
+
+    return changed;
+}
+
+
+
+static GPtrArray *
+xfce_workspaces_helper_get_names (XfceWorkspacesHelper *helper)
+{
+    gint         i, length, num;
+    GPtrArray   *names = NULL;
+    GValue      *val;
+    const gchar *p, *data;
+
+    if (helper->desktop_names == NULL)
+        xfce_workspaces_helper_read_desktop_names (helper);
+
+    data = helper->desktop_names->str;
+    length = helper->desktop_names->len;
+
+    if (length > 0)
     {
         names = g_ptr_array_new ();
 
@@ -232,7 +287,6 @@ xfce_workspaces_helper_get_names (void)
             {
                 g_warning ("Name of workspace %d is not UTF-8 valid.", num + 1);
                 xfconf_array_free (names);
-                g_free (data);
 
                 return NULL;
             }
@@ -247,8 +301,6 @@ xfce_workspaces_helper_get_names (void)
         }
     }
 
-    g_free (data);
-
     return names;
 }
 
@@ -293,6 +345,67 @@ xfce_workspaces_helper_get_count (void)
 
 
 
+static void
+xfce_workspaces_helper_write_names (XfceWorkspacesHelper *helper,
+                                    const GString        *names_str)
+{
+    GString       *current = helper->desktop_names;
+    GdkPropMode    mode = GDK_PROP_MODE_REPLACE;
+    const gchar   *data = names_str->str;
+    gsize          len = names_str->len;
+
+    if (current != NULL
+        && current->len >= names_str->len
+        && memcmp (current->str, names_str->str, names_str->len) == 0)
+    {
+        /* the property already starts with these names, names beyond
+         * the workspace count are reserved for new workspaces (EWMH) */
+        xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "desktop names are up-to-date");
+        return;
+    }
+
+    if (current != NULL
+        && current->len > 0
+        && current->len < names_str->len
+        && memcmp (current->str, names_str->str, current->len) == 0)
+    {
+        /* only names were added, append them to the property */
+        mode = GDK_PROP_MODE_APPEND;
+        data += current->len;
+        len -= current->len;
+    }
+
+    gdk_error_trap_push ();
+
+    gdk_property_change (gdk_get_default_root_window (),
+                         gdk_atom_intern_static_string ("_NET_DESKTOP_NAMES"),
+                         gdk_atom_intern_static_string ("UTF8_STRING"),
+                         8, mode, (const guchar *) data, len);
+
+    if (gdk_error_trap_pop () != 0)
+    {
+        g_warning ("Failed to change _NET_DESKTOP_NAMES.");
+
+        /* unknown property contents, read them again next time */
+        if (current != NULL)
+            g_string_free (current, TRUE);
+        helper->desktop_names = NULL;
+
+        return;
+    }
+
+    if (current == NULL)
+        current = helper->desktop_names = g_string_new (NULL);
+    if (mode == GDK_PROP_MODE_REPLACE)
+        g_string_truncate (current, 0);
+    g_string_append_len (current, data, len);
+
+    xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "%s %" G_GSIZE_FORMAT " bytes of desktop names",
+                    mode == GDK_PROP_MODE_APPEND ? "appended" : "replaced", len);
+}
+
+
+
 static void
 xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
 {
@@ -313,11 +426,15 @@ xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
     /* check if there are enough names in xfconf, else we save new
      * names first and set the names the next time property-changed is
      * triggered on the channel */
-    names = xfconf_channel_get_arrayv (helper->channel, WORKSPACE_NAMES_PROP);
+    names = helper->names;
     if (names != NULL && names->len >= n_workspaces)
     {
         /* store this in xfconf (for no really good reason actually) */
-        xfconf_channel_set_int (helper->channel, WORKSPACE_COUNT_PROP, n_workspaces);
+        if (helper->n_workspaces != n_workspaces)
+        {
+            xfconf_channel_set_int (helper->channel, WORKSPACE_COUNT_PROP, n_workspaces);
+            helper->n_workspaces = n_workspaces;
+        }
 
         /* create nul-separated string of names */
         names_str = g_string_new (NULL);
@@ -342,21 +459,8 @@ xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
             }
         }
 
-        /* update stamp so new names is not handled for the next second */
-        g_get_current_time (&helper->timestamp);
-        g_time_val_add (&helper->timestamp, G_USEC_PER_SEC);
-
-        gdk_error_trap_push();
-
-        gdk_property_change (gdk_get_default_root_window (),
-                             gdk_atom_intern_static_string ("_NET_DESKTOP_NAMES"),
-                             gdk_atom_intern_static_string ("UTF8_STRING"),
-                             8, GDK_PROP_MODE_REPLACE,
-                             (guchar *) names_str->str,
-                             names_str->len + 1);
-
-        if (gdk_error_trap_pop () != 0)
-            g_warning ("Failed to change _NET_DESKTOP_NAMES.");
+        /* only write what differs from the current property */
+        xfce_workspaces_helper_write_names (helper, names_str);
 
         xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "%d desktop names set from xfconf", i);
 
@@ -365,10 +469,10 @@ xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
     else
     {
         if (names == NULL)
-            names = g_ptr_array_sized_new (n_workspaces);
+            names = helper->names = g_ptr_array_sized_new (n_workspaces);
 
         /* get current names set in x */
-        existing_names = xfce_workspaces_helper_get_names ();
+        existing_names = xfce_workspaces_helper_get_names (helper);
 
         for (i = names->len; i < n_workspaces; i++)
         {
@@ -400,14 +504,19 @@ xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
 
         /* store new array in xfconf */
         if (!xfconf_channel_set_arrayv (helper->channel, WORKSPACE_NAMES_PROP, names))
+        {
              g_critical ("Failed to save xfconf property %s", WORKSPACE_NAMES_PROP);
 
+             /* drop the names we could not store */
+             xfconf_array_free (helper->names);
+             helper->names = xfconf_channel_get_arrayv (helper->channel, WORKSPACE_NAMES_PROP);
+        }
+
         xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "extended names in xfconf, waiting for property-change");
 
-        xfconf_array_free (existing_names);
+        if (existing_names != NULL)
+            xfconf_array_free (existing_names);
     }
-
-    xfconf_array_free (names);
 }
 
 
@@ -526,11 +635,11 @@ xfce_workspaces_helper_save_names (XfceWorkspacesHelper *helper)
 
     g_return_if_fail (XFCE_IS_WORKSPACES_HELPER (helper));
 
-    new_names = xfce_workspaces_helper_get_names ();
+    new_names = xfce_workspaces_helper_get_names (helper);
     if (new_names == NULL)
         return;
 
-    xfconf_names = xfconf_channel_get_arrayv (helper->channel, WORKSPACE_NAMES_PROP);
+    xfconf_names = helper->names;
 
     if (xfconf_names == NULL
        || xfconf_names->len < new_names->len)
@@ -545,13 +654,13 @@ xfce_workspaces_helper_save_names (XfceWorkspacesHelper *helper)
     else if (xfconf_names != NULL
              && xfconf_names->len >= new_names->len)
     {
-        /* update the new names in the xfconf array */
+        /* update the new names in the cached xfconf array */
         for (i = 0; i < new_names->len; i++)
         {
              name_a = g_value_get_string (g_ptr_array_index (new_names, i));
 
              val_b = g_ptr_array_index (xfconf_names, i);
-             name_b = g_value_get_string (val_b);
+             name_b = G_VALUE_HOLDS_STRING (val_b) ? g_value_get_string (val_b) : NULL;
 
              if (g_strcmp0 (name_a, name_b) != 0)
              {
@@ -571,10 +680,12 @@ xfce_workspaces_helper_save_names (XfceWorkspacesHelper *helper)
             xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "merged %d xfconf and %d desktop names",
                             xfconf_names->len, new_names->len);
         }
+        else
+        {
+            xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "desktop names match xfconf");
+        }
     }
 
-    if (xfconf_names != NULL)
-        xfconf_array_free (xfconf_names);
     xfconf_array_free (new_names);
 }
 
@@ -588,6 +699,11 @@ xfce_workspaces_helper_prop_changed (XfconfChannel        *channel,
 {
     g_return_if_fail (XFCE_IS_WORKSPACES_HELPER (helper));
 
+    /* refresh the cached names */
+    if (helper->names != NULL)
+        xfconf_array_free (helper->names);
+    helper->names = xfconf_channel_get_arrayv (helper->channel, WORKSPACE_NAMES_PROP);
+
     if (helper->wait_for_wm_timeout_id == 0)
     {
         /* only set the names if the initial start is not running anymore */
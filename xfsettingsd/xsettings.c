@@ -35,6 +35,12 @@
 #ifdef HAVE_TIME_H
 #include <time.h>
 #endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
 #include <X11/Xlib.h>
 #include <X11/Xmd.h>
@@ -49,6 +55,8 @@
 #include <gio/gio.h>
 #include <fontconfig/fontconfig.h>
 
+#include <dbus/dbus-glib.h>
+
 #include "xsettings.h"
 #include "debug.h"
 
@@ -58,26 +66,45 @@
 
 #define XSETTINGS_PAD(n,m) ((n + m - 1) & (~(m-1)))
 
+#define XFCONF_TYPE_G_VALUE_ARRAY (dbus_g_type_get_collection ("GPtrArray", G_TYPE_VALUE))
+
 #define DPI_FALLBACK        96
 #define DPI_LOW_REASONABLE  50
 #define DPI_HIGH_REASONABLE 500
 
-#define FC_TIMEOUT_SEC 2 /* timeout before xsettings notify */
-#define FC_PROPERTY    "/Fontconfig/Timestamp"
+#define FC_TIMEOUT_SEC     2  /* timeout before xsettings notify */
+#define FC_TIMEOUT_MAX_SEC 10 /* maximum delay during a burst of changes */
+#define FC_PROPERTY        "/Fontconfig/Timestamp"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#define FC_INOTIFY_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE \
+                         | IN_DELETE | IN_DELETE_SELF | IN_MOVED_FROM \
+                         | IN_MOVED_TO | IN_MOVE_SELF)
+#endif
+
+#define COALESCE_PROPERTY   "/Net/NotifyCoalesceMs"
+#define COALESCE_DEFAULT_MS 50
+#define COALESCE_MAX_MS     1000
 
 
 
 typedef struct _XfceXSettingsScreen XfceXSettingsScreen;
 typedef struct _XfceXSetting        XfceXSetting;
 typedef struct _XfceXSettingsNotify XfceXSettingsNotify;
+#ifdef HAVE_SYS_INOTIFY_H
+typedef struct _XfceFcWatchNode     XfceFcWatchNode;
+#endif
 
 
 
 static void     xfce_xsettings_helper_finalize     (GObject             *object);
 static void     xfce_xsettings_helper_fc_free      (XfceXSettingsHelper *helper);
 static gboolean xfce_xsettings_helper_fc_init      (gpointer             data);
+static gboolean xfce_xsettings_helper_fc_notify    (gpointer             data);
 static gboolean xfce_xsettings_helper_notify_idle  (gpointer             data);
-static void     xfce_xsettings_helper_setting_free (gpointer             data);
+static void     xfce_xsettings_helper_schedule_notify (XfceXSettingsHelper *helper,
+                                                       gboolean             xft);
+static void     xfce_xsettings_helper_setting_clear (XfceXSetting        *setting);
 static void     xfce_xsettings_helper_prop_changed (XfconfChannel       *channel,
                                                     const gchar         *prop_name,
                                                     const GValue        *value,
@@ -86,6 +113,8 @@ static void     xfce_xsettings_helper_load         (XfceXSettingsHelper *helper)
 static void     xfce_xsettings_helper_screen_free  (XfceXSettingsScreen *screen);
 static void     xfce_xsettings_helper_notify_xft   (XfceXSettingsHelper *helper);
 static void     xfce_xsettings_helper_notify       (XfceXSettingsHelper *helper);
+static void     xfce_xsettings_helper_setting_changed (XfceXSettingsHelper *helper,
+                                                       XfceXSetting        *setting);
 
 
 
@@ -103,45 +132,135 @@ struct _XfceXSettingsHelper
     /* list of XfceXSettingsScreen we handle */
     GSList        *screens;
 
-    /* table with xfconf property keyd and XfceXSetting */
-    GHashTable    *settings;
+    /* contiguous array of XfceXSetting and a table with the
+     * interned xfconf property name -> array index + 1 */
+    GArray        *settings;
+    GHashTable    *settings_index;
 
     /* auto increasing serial for each time we notify */
     gulong         serial;
 
-    /* idle notifications */
+    /* pre-laid-out _XSETTINGS_SETTINGS buffer */
+    XfceXSettingsNotify *notify;
+
+    /* coalesced notifications */
     guint          notify_idle_id;
-    guint          notify_xft_idle_id;
+    guint          notify_xft_pending : 1;
+
+    /* maximum delay between the first change and the notification */
+    guint          notify_coalesce_ms;
 
     /* atom for xsetting property changes */
     Atom           xsettings_atom;
 
+    /* display we registered on */
+    Display       *xdisplay;
+
+    /* parsed resource manager string: lines and
+     * resource name -> line index + 1 */
+    GPtrArray     *xft_lines;
+    GHashTable    *xft_index;
+    gchar         *xft_written;
+
     /* fontconfig monitoring */
-    GPtrArray     *fc_monitors;
-    guint          fc_notify_timeout_id;
-    guint          fc_init_id;
+#ifdef HAVE_SYS_INOTIFY_H
+    gint             fc_inotify_fd;
+    guint            fc_inotify_watch_id;
+    XfceFcWatchNode *fc_watch_root;
+    GHashTable      *fc_watches; /* wd -> XfceFcWatchNode */
+    guint            fc_generation;
+#else
+    GPtrArray       *fc_monitors;
+#endif
+    guint            fc_n_watches;
+    guint            fc_notify_timeout_id;
+    guint            fc_init_id;
+    time_t           fc_first_change;
+
+    /* fontconfig rescans run in a worker thread */
+    GThreadPool     *fc_pool;
+    guint            fc_rescan_running : 1;
+    guint            fc_rescan_again : 1;
+
+    /* written by the worker before it queues the idle, so it must
+     * not share a word with the bitfields the main loop writes */
+    gboolean         fc_rescan_updated;
 };
 
 struct _XfceXSetting
 {
-    GValue *value;
-    gulong  last_change_serial;
+    /* interned xfconf property name */
+    const gchar *name;
+
+    /* one of the XSettingsType* values */
+    guchar       type;
+
+    union
+    {
+        gint     v_int;
+        gchar   *v_string;
+        guint16  v_color[4]; /* red, green, blue, alpha */
+    }
+    value;
+
+    gulong       last_change_serial;
+
+    /* location of the record in the notify buffer, only
+     * valid while the buffer layout is not dirty */
+    gsize        size;
+    gsize        value_offset;
 };
 
 struct _XfceXSettingsNotify
 {
-    guchar *buf;
-    gsize   buf_len;
-    gint    n_settings;
-    gsize   dpi_offset;
+    guchar  *buf;
+    gsize    buf_len;
+    gint     n_settings;
+    gsize    dpi_offset;
+
+    /* dpi currently patched at dpi_offset, 0 if unknown */
+    gint     buf_dpi;
+
+    /* increased each time the settings in the buffer change */
+    guint    content_serial;
+
+    /* whether the buffer has to be rebuilt from the settings
+     * table, because a setting was added, removed or resized */
+    guint    layout_dirty : 1;
 };
 
+#ifdef HAVE_SYS_INOTIFY_H
+struct _XfceFcWatchNode
+{
+    /* path component and children, keyed by component */
+    gchar           *name;
+    XfceFcWatchNode *parent;
+    GHashTable      *children;
+
+    /* inotify watch descriptor or -1 */
+    gint             wd;
+
+    /* fc_generation in which fontconfig last listed this path */
+    guint            generation;
+};
+#endif
+
 struct _XfceXSettingsScreen
 {
-    Display *xdisplay;
-    Window   window;
-    Atom     selection_atom;
-    gint     screen_num;
+    Display   *xdisplay;
+    Window     window;
+    Atom       selection_atom;
+    gint       screen_num;
+
+    GdkScreen *gdkscreen;
+    gulong     size_changed_id;
+
+    /* dpi of the screen, only updated on geometry changes */
+    gint       dpi;
+
+    /* content serial and dpi last written to the window */
+    guint      written_content_serial;
+    gint       written_dpi;
 };
 
 
@@ -166,8 +285,19 @@ xfce_xsettings_helper_init (XfceXSettingsHelper *helper)
 {
     helper->channel = xfconf_channel_new ("xsettings");
 
-    helper->settings = g_hash_table_new_full (g_str_hash, g_str_equal,
-        g_free, xfce_xsettings_helper_setting_free);
+#ifdef HAVE_SYS_INOTIFY_H
+    helper->fc_inotify_fd = -1;
+#endif
+
+    helper->settings = g_array_new (FALSE, TRUE, sizeof (XfceXSetting));
+    helper->settings_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+    helper->notify = g_slice_new0 (XfceXSettingsNotify);
+    helper->notify->layout_dirty = TRUE;
+    helper->notify->content_serial = 1;
+
+    helper->notify_coalesce_ms = CLAMP (xfconf_channel_get_int (helper->channel,
+        COALESCE_PROPERTY, COALESCE_DEFAULT_MS), 0, COALESCE_MAX_MS);
 
     xfce_xsettings_helper_load (helper);
 
@@ -182,17 +312,19 @@ xfce_xsettings_helper_finalize (GObject *object)
 {
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (object);
     GSList              *li;
+    guint                i;
 
     /* stop fontconfig monitoring */
     xfce_xsettings_helper_fc_free (helper);
 
+    /* the running rescan holds a reference, so the pool is idle */
+    if (helper->fc_pool != NULL)
+        g_thread_pool_free (helper->fc_pool, TRUE, TRUE);
+
     /* stop pending update */
     if (helper->notify_idle_id != 0)
         g_source_remove (helper->notify_idle_id);
 
-    if (helper->notify_xft_idle_id != 0)
-        g_source_remove (helper->notify_xft_idle_id);
-
     g_object_unref (G_OBJECT (helper->channel));
 
     /* remove screens */
@@ -200,52 +332,265 @@ xfce_xsettings_helper_finalize (GObject *object)
         xfce_xsettings_helper_screen_free (li->data);
     g_slist_free (helper->screens);
 
-    g_hash_table_destroy (helper->settings);
+    for (i = 0; i < helper->settings->len; i++)
+        xfce_xsettings_helper_setting_clear (&g_array_index (helper->settings, XfceXSetting, i));
+    g_array_free (helper->settings, TRUE);
+    g_hash_table_destroy (helper->settings_index);
+
+    g_free (helper->notify->buf);
+    g_slice_free (XfceXSettingsNotify, helper->notify);
+
+    if (helper->xft_lines != NULL)
+    {
+        g_ptr_array_foreach (helper->xft_lines, (GFunc) g_free, NULL);
+        g_ptr_array_free (helper->xft_lines, TRUE);
+        g_hash_table_destroy (helper->xft_index);
+    }
+    g_free (helper->xft_written);
 
     (*G_OBJECT_CLASS (xfce_xsettings_helper_parent_class)->finalize) (object);
 }
 
 
 
+static void
+xfce_xsettings_helper_setting_clear (XfceXSetting *setting)
+{
+    if (setting->type == XSettingsTypeString)
+        g_free (setting->value.v_string);
+
+    setting->value.v_string = NULL;
+}
+
+
+
+static XfceXSetting *
+xfce_xsettings_helper_setting_lookup (XfceXSettingsHelper *helper,
+                                      const gchar         *name)
+{
+    guint idx;
+
+    idx = GPOINTER_TO_UINT (g_hash_table_lookup (helper->settings_index, name));
+    if (idx == 0)
+        return NULL;
+
+    return &g_array_index (helper->settings, XfceXSetting, idx - 1);
+}
+
+
+
+static XfceXSetting *
+xfce_xsettings_helper_setting_insert (XfceXSettingsHelper *helper,
+                                      const gchar         *name)
+{
+    XfceXSetting *setting;
+
+    /* the array clears new items */
+    g_array_set_size (helper->settings, helper->settings->len + 1);
+    setting = &g_array_index (helper->settings, XfceXSetting, helper->settings->len - 1);
+    setting->name = g_intern_string (name);
+
+    g_hash_table_insert (helper->settings_index, (gpointer) setting->name,
+                         GUINT_TO_POINTER (helper->settings->len));
+
+    helper->notify->layout_dirty = TRUE;
+
+    return setting;
+}
+
+
+
 static gboolean
-xfce_xsettings_helper_fc_notify (gpointer data)
+xfce_xsettings_helper_setting_remove (XfceXSettingsHelper *helper,
+                                      const gchar         *name)
+{
+    guint         idx;
+    XfceXSetting *moved;
+
+    idx = GPOINTER_TO_UINT (g_hash_table_lookup (helper->settings_index, name));
+    if (idx == 0)
+        return FALSE;
+
+    xfce_xsettings_helper_setting_clear (&g_array_index (helper->settings, XfceXSetting, idx - 1));
+    g_hash_table_remove (helper->settings_index, name);
+
+    /* the last setting is moved into the hole */
+    g_array_remove_index_fast (helper->settings, idx - 1);
+    if (idx - 1 < helper->settings->len)
+    {
+        moved = &g_array_index (helper->settings, XfceXSetting, idx - 1);
+        g_hash_table_insert (helper->settings_index, (gpointer) moved->name,
+                             GUINT_TO_POINTER (idx));
+    }
+
+    helper->notify->layout_dirty = TRUE;
+
+    return TRUE;
+}
+
+
+
+static gboolean
+xfce_xsettings_helper_color_component (const GValue *value,
+                                       guint16      *component)
+{
+    if (G_VALUE_TYPE (value) == XFCONF_TYPE_UINT16)
+        *component = xfconf_g_value_get_uint16 (value);
+    else if (G_VALUE_HOLDS_UINT (value))
+        *component = MIN (g_value_get_uint (value), G_MAXUINT16);
+    else if (G_VALUE_HOLDS_INT (value))
+        *component = CLAMP (g_value_get_int (value), 0, G_MAXUINT16);
+    else if (G_VALUE_HOLDS_DOUBLE (value))
+        *component = CLAMP (g_value_get_double (value), 0.0, 1.0) * G_MAXUINT16;
+    else
+        return FALSE;
+
+    return TRUE;
+}
+
+
+
+static gboolean
+xfce_xsettings_helper_setting_set_value (XfceXSetting *setting,
+                                         const GValue *value)
+{
+    GPtrArray *array;
+    guint16    color[4] = { 0, 0, 0, G_MAXUINT16 };
+    guint      i;
+
+    if (G_VALUE_HOLDS_INT (value))
+    {
+        xfce_xsettings_helper_setting_clear (setting);
+        setting->type = XSettingsTypeInteger;
+        setting->value.v_int = g_value_get_int (value);
+    }
+    else if (G_VALUE_HOLDS_BOOLEAN (value))
+    {
+        xfce_xsettings_helper_setting_clear (setting);
+        setting->type = XSettingsTypeInteger;
+        setting->value.v_int = g_value_get_boolean (value);
+    }
+    else if (G_VALUE_HOLDS_STRING (value))
+    {
+        xfce_xsettings_helper_setting_clear (setting);
+        setting->type = XSettingsTypeString;
+        setting->value.v_string = g_value_dup_string (value);
+    }
+    else if (G_VALUE_TYPE (value) == XFCONF_TYPE_G_VALUE_ARRAY)
+    {
+        /* colors are stored as an rgb or rgba array, like
+         * the xfdesktop backdrop colors */
+        array = g_value_get_boxed (value);
+        if (array == NULL || (array->len != 3 && array->len != 4))
+            return FALSE;
+
+        for (i = 0; i < array->len; i++)
+            if (!xfce_xsettings_helper_color_component (g_ptr_array_index (array, i), &color[i]))
+                return FALSE;
+
+        xfce_xsettings_helper_setting_clear (setting);
+        setting->type = XSettingsTypeColor;
+        memcpy (setting->value.v_color, color, sizeof (color));
+    }
+    else
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+
+static gboolean
+xfce_xsettings_helper_fc_rescan_done (gpointer data)
 {
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
     XfceXSetting        *setting;
 
-    helper->fc_notify_timeout_id = 0;
+    helper->fc_rescan_running = FALSE;
 
-    /* check if the font config setup changed */
-    if (!FcConfigUptoDate (NULL) && FcInitReinitialize ())
+    if (helper->fc_rescan_updated)
     {
-        /* stop the monitors */
-        xfce_xsettings_helper_fc_free (helper);
-
-        setting = g_hash_table_lookup (helper->settings, FC_PROPERTY);
+        setting = xfce_xsettings_helper_setting_lookup (helper, FC_PROPERTY);
         if (setting == NULL)
         {
             /* create new setting */
-            setting = g_slice_new0 (XfceXSetting);
-            setting->value = g_new0 (GValue, 1);
-            g_value_init (setting->value, G_TYPE_INT);
-            g_hash_table_insert (helper->settings, g_strdup (FC_PROPERTY), setting);
+            setting = xfce_xsettings_helper_setting_insert (helper, FC_PROPERTY);
+            setting->type = XSettingsTypeInteger;
         }
 
         /* update setting */
         setting->last_change_serial = helper->serial;
-        g_value_set_int (setting->value, time (NULL));
+        setting->value.v_int = time (NULL);
+        xfce_xsettings_helper_setting_changed (helper, setting);
 
         xfsettings_dbg (XFSD_DEBUG_FONTCONFIG, "timestamp updated (time=%d)",
-                        g_value_get_int (setting->value));
+                        setting->value.v_int);
 
         /* schedule xsettings update */
-        if (helper->notify_idle_id == 0)
-            helper->notify_idle_id = g_idle_add (xfce_xsettings_helper_notify_idle, helper);
+        xfce_xsettings_helper_schedule_notify (helper, FALSE);
 
-        /* restart monitoring */
-        helper->fc_init_id = g_idle_add (xfce_xsettings_helper_fc_init, helper);
+        /* update monitoring for the new config and font dirs */
+        if (helper->fc_init_id == 0)
+            helper->fc_init_id = g_idle_add (xfce_xsettings_helper_fc_init, helper);
     }
 
+    /* changes arrived during the rescan */
+    if (helper->fc_rescan_again)
+        xfce_xsettings_helper_fc_notify (helper);
+
+    /* release the reference of the worker */
+    g_object_unref (G_OBJECT (helper));
+
+    return FALSE;
+}
+
+
+
+static void
+xfce_xsettings_helper_fc_rescan (gpointer data,
+                                 gpointer user_data)
+{
+    XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
+
+    /* check if the font config setup changed, this can take
+     * seconds on large font collections */
+    helper->fc_rescan_updated = !FcConfigUptoDate (NULL) && FcInitReinitialize ();
+
+    /* report back in the main loop */
+    g_idle_add (xfce_xsettings_helper_fc_rescan_done, helper);
+}
+
+
+
+static gboolean
+xfce_xsettings_helper_fc_notify (gpointer data)
+{
+    XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
+
+    helper->fc_notify_timeout_id = 0;
+    helper->fc_first_change = 0;
+
+    /* try again when the running rescan is finished */
+    if (helper->fc_rescan_running)
+    {
+        helper->fc_rescan_again = TRUE;
+        return FALSE;
+    }
+
+    if (helper->fc_pool == NULL)
+    {
+        helper->fc_pool = g_thread_pool_new (xfce_xsettings_helper_fc_rescan,
+                                             NULL, 1, FALSE, NULL);
+    }
+
+    helper->fc_rescan_running = TRUE;
+    helper->fc_rescan_again = FALSE;
+
+    /* keep the helper alive until the rescan reported back */
+    g_thread_pool_push (helper->fc_pool, g_object_ref (G_OBJECT (helper)), NULL);
+
     return FALSE;
 }
 
@@ -254,16 +599,368 @@ xfce_xsettings_helper_fc_notify (gpointer data)
 static void
 xfce_xsettings_helper_fc_changed (XfceXSettingsHelper *helper)
 {
-    /* reschedule monitor */
+    time_t now = time (NULL);
+
     if (helper->fc_notify_timeout_id != 0)
+    {
+        /* don't postpone forever during a long burst, let the
+         * pending timeout fire */
+        if (now - helper->fc_first_change >= FC_TIMEOUT_MAX_SEC)
+            return;
+
         g_source_remove (helper->fc_notify_timeout_id);
+    }
+    else
+    {
+        helper->fc_first_change = now;
+    }
 
+    /* reschedule monitor */
     helper->fc_notify_timeout_id = g_timeout_add_seconds (FC_TIMEOUT_SEC,
         xfce_xsettings_helper_fc_notify, helper);
 }
 
 
 
+#ifdef HAVE_SYS_INOTIFY_H
+static void
+xfce_xsettings_helper_fc_node_unwatch (XfceXSettingsHelper *helper,
+                                       XfceFcWatchNode     *node)
+{
+    if (node->wd >= 0)
+    {
+        inotify_rm_watch (helper->fc_inotify_fd, node->wd);
+        g_hash_table_remove (helper->fc_watches, GINT_TO_POINTER (node->wd));
+        node->wd = -1;
+        helper->fc_n_watches--;
+    }
+}
+
+
+
+static void
+xfce_xsettings_helper_fc_node_free (gpointer data)
+{
+    XfceFcWatchNode *node = data;
+
+    /* watches have been removed by the caller */
+    g_assert (node->wd < 0);
+
+    if (node->children != NULL)
+        g_hash_table_destroy (node->children);
+    g_free (node->name);
+    g_slice_free (XfceFcWatchNode, node);
+}
+
+
+
+static XfceFcWatchNode *
+xfce_xsettings_helper_fc_node_get (XfceFcWatchNode *root,
+                                   const gchar     *path)
+{
+    gchar           **parts;
+    XfceFcWatchNode  *node = root;
+    XfceFcWatchNode  *child;
+    guint             i;
+
+    parts = g_strsplit (path, G_DIR_SEPARATOR_S, -1);
+    for (i = 0; parts[i] != NULL; i++)
+    {
+        if (*parts[i] == '\0')
+            continue;
+
+        if (node->children == NULL)
+        {
+            node->children = g_hash_table_new_full (g_str_hash, g_str_equal,
+                NULL, xfce_xsettings_helper_fc_node_free);
+            child = NULL;
+        }
+        else
+        {
+            child = g_hash_table_lookup (node->children, parts[i]);
+        }
+
+        if (child == NULL)
+        {
+            child = g_slice_new0 (XfceFcWatchNode);
+            child->name = g_strdup (parts[i]);
+            child->parent = node;
+            child->wd = -1;
+            g_hash_table_insert (node->children, child->name, child);
+        }
+
+        node = child;
+    }
+    g_strfreev (parts);
+
+    return node;
+}
+
+
+
+static gboolean
+xfce_xsettings_helper_fc_node_sweep (gpointer             key,
+                                     XfceFcWatchNode     *node,
+                                     XfceXSettingsHelper *helper)
+{
+    /* first handle the subtree */
+    if (node->children != NULL)
+    {
+        g_hash_table_foreach_remove (node->children,
+            (GHRFunc) xfce_xsettings_helper_fc_node_sweep, helper);
+
+        if (g_hash_table_size (node->children) == 0)
+        {
+            g_hash_table_destroy (node->children);
+            node->children = NULL;
+        }
+    }
+
+    /* fontconfig no longer uses this path */
+    if (node->generation != helper->fc_generation)
+        xfce_xsettings_helper_fc_node_unwatch (helper, node);
+
+    /* remove the node if it's of no use anymore */
+    return node->wd < 0 && node->children == NULL;
+}
+
+
+
+static void
+xfce_xsettings_helper_fc_node_unwatch_all (XfceXSettingsHelper *helper,
+                                           XfceFcWatchNode     *node)
+{
+    GHashTableIter   iter;
+    XfceFcWatchNode *child;
+
+    if (node->children != NULL)
+    {
+        g_hash_table_iter_init (&iter, node->children);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &child))
+            xfce_xsettings_helper_fc_node_unwatch_all (helper, child);
+    }
+
+    xfce_xsettings_helper_fc_node_unwatch (helper, node);
+}
+
+
+
+static gboolean
+xfce_xsettings_helper_fc_inotify (GIOChannel   *source,
+                                  GIOCondition  condition,
+                                  gpointer      data)
+{
+    XfceXSettingsHelper        *helper = XFCE_XSETTINGS_HELPER (data);
+    union
+    {
+        struct inotify_event    event;
+        gchar                   buf[4096];
+    }                           events;
+    const struct inotify_event *event;
+    XfceFcWatchNode            *node;
+    gssize                      len;
+    gssize                      pos;
+    gboolean                    changed = FALSE;
+
+    for (;;)
+    {
+        len = read (helper->fc_inotify_fd, events.buf, sizeof (events.buf));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            break;
+
+        for (pos = 0; pos < len; pos += sizeof (struct inotify_event) + event->len)
+        {
+            event = (const struct inotify_event *) (events.buf + pos);
+
+            if ((event->mask & IN_IGNORED) != 0)
+            {
+                /* watches removed by the sweep are no longer in the
+                 * table, their IN_IGNORED is not a font change */
+                node = g_hash_table_lookup (helper->fc_watches, GINT_TO_POINTER (event->wd));
+                if (node == NULL)
+                    continue;
+
+                /* the kernel dropped the watch, the path is gone */
+                g_hash_table_remove (helper->fc_watches, GINT_TO_POINTER (event->wd));
+                node->wd = -1;
+                helper->fc_n_watches--;
+            }
+
+            changed = TRUE;
+        }
+    }
+
+    if (changed)
+        xfce_xsettings_helper_fc_changed (helper);
+
+    return TRUE;
+}
+
+
+
+static void
+xfce_xsettings_helper_fc_watch (XfceXSettingsHelper *helper,
+                                const gchar         *path)
+{
+    XfceFcWatchNode *node;
+    gint             wd;
+    gchar           *parent;
+
+    node = xfce_xsettings_helper_fc_node_get (helper->fc_watch_root, path);
+    node->generation = helper->fc_generation;
+
+    /* already watched from a previous run */
+    if (node->wd >= 0)
+        return;
+
+    wd = inotify_add_watch (helper->fc_inotify_fd, path, FC_INOTIFY_MASK);
+    if (wd < 0)
+    {
+        /* watch the parent for directories that don't exist
+         * yet, like ~/.fonts */
+        if (errno == ENOENT && strcmp (path, G_DIR_SEPARATOR_S) != 0)
+        {
+            parent = g_path_get_dirname (path);
+            xfce_xsettings_helper_fc_watch (helper, parent);
+            g_free (parent);
+        }
+
+        return;
+    }
+
+    /* the same inode can be listed through a symlink, in which
+     * case the existing watch already covers it */
+    if (g_hash_table_lookup (helper->fc_watches, GINT_TO_POINTER (wd)) == NULL)
+    {
+        node->wd = wd;
+        g_hash_table_insert (helper->fc_watches, GINT_TO_POINTER (wd), node);
+        helper->fc_n_watches++;
+
+        xfsettings_dbg_filtered (XFSD_DEBUG_FONTCONFIG, "monitoring \"%s\"",
+                                 path);
+    }
+}
+
+
+
+static void
+xfce_xsettings_helper_fc_monitor (XfceXSettingsHelper *helper,
+                                  FcStrList           *files)
+{
+    const gchar *path;
+
+    if (G_UNLIKELY (files == NULL))
+        return;
+
+    for (;;)
+    {
+        path = (const gchar *) FcStrListNext (files);
+        if (G_UNLIKELY (path == NULL))
+            break;
+
+        xfce_xsettings_helper_fc_watch (helper, path);
+    }
+
+    FcStrListDone (files);
+}
+
+
+
+static void
+xfce_xsettings_helper_fc_free (XfceXSettingsHelper *helper)
+{
+    if (helper->fc_notify_timeout_id != 0)
+    {
+        /* stop update timeout */
+        g_source_remove (helper->fc_notify_timeout_id);
+        helper->fc_notify_timeout_id = 0;
+    }
+
+    if (helper->fc_init_id != 0)
+    {
+        /* stop startup timeout */
+        g_source_remove (helper->fc_init_id);
+        helper->fc_init_id = 0;
+    }
+
+    if (helper->fc_inotify_fd >= 0)
+    {
+        /* remove watches */
+        g_source_remove (helper->fc_inotify_watch_id);
+        xfce_xsettings_helper_fc_node_unwatch_all (helper, helper->fc_watch_root);
+        xfce_xsettings_helper_fc_node_free (helper->fc_watch_root);
+        g_hash_table_destroy (helper->fc_watches);
+        close (helper->fc_inotify_fd);
+
+        helper->fc_inotify_fd = -1;
+        helper->fc_watch_root = NULL;
+        helper->fc_watches = NULL;
+    }
+}
+
+
+
+static gboolean
+xfce_xsettings_helper_fc_init (gpointer data)
+{
+    XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
+    GIOChannel          *channel;
+    guint                n_watches;
+
+    helper->fc_init_id = 0;
+
+    /* the rescan will schedule a new run when done */
+    if (helper->fc_rescan_running)
+        return FALSE;
+
+    if (!FcInit ())
+        return FALSE;
+
+    if (helper->fc_inotify_fd < 0)
+    {
+        /* single inotify instance for all the paths */
+        helper->fc_inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+        if (helper->fc_inotify_fd < 0)
+        {
+            g_warning ("Failed to start fontconfig monitoring: %s", g_strerror (errno));
+            return FALSE;
+        }
+
+        channel = g_io_channel_unix_new (helper->fc_inotify_fd);
+        helper->fc_inotify_watch_id = g_io_add_watch (channel, G_IO_IN,
+            xfce_xsettings_helper_fc_inotify, helper);
+        g_io_channel_unref (channel);
+
+        helper->fc_watch_root = g_slice_new0 (XfceFcWatchNode);
+        helper->fc_watch_root->wd = -1;
+        helper->fc_watches = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+
+    /* mark the paths fontconfig uses now and add new watches */
+    n_watches = helper->fc_n_watches;
+    helper->fc_generation++;
+    xfce_xsettings_helper_fc_monitor (helper, FcConfigGetConfigFiles (NULL));
+    xfce_xsettings_helper_fc_monitor (helper, FcConfigGetFontDirs (NULL));
+    n_watches = helper->fc_n_watches - n_watches;
+
+    /* drop the watches of paths that are no longer used */
+    if (helper->fc_watch_root->children != NULL)
+    {
+        g_hash_table_foreach_remove (helper->fc_watch_root->children,
+            (GHRFunc) xfce_xsettings_helper_fc_node_sweep, helper);
+    }
+
+    xfsettings_dbg (XFSD_DEBUG_FONTCONFIG, "monitoring %u paths (%u new watches)",
+                    helper->fc_n_watches, n_watches);
+
+    return FALSE;
+}
+#else
+
+
+
 static void
 xfce_xsettings_helper_fc_free (XfceXSettingsHelper *helper)
 {
@@ -287,6 +984,7 @@ xfce_xsettings_helper_fc_free (XfceXSettingsHelper *helper)
         g_ptr_array_foreach (helper->fc_monitors, (GFunc) g_object_unref, NULL);
         g_ptr_array_free (helper->fc_monitors, TRUE);
         helper->fc_monitors = NULL;
+        helper->fc_n_watches = 0;
     }
 }
 
@@ -334,10 +1032,20 @@ xfce_xsettings_helper_fc_init (gpointer data)
 {
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
 
-    g_return_val_if_fail (helper->fc_monitors == NULL, FALSE);
-
     helper->fc_init_id = 0;
 
+    /* the rescan will schedule a new run when done */
+    if (helper->fc_rescan_running)
+        return FALSE;
+
+    /* without inotify the monitors are rebuilt from scratch */
+    if (helper->fc_monitors != NULL)
+    {
+        g_ptr_array_foreach (helper->fc_monitors, (GFunc) g_object_unref, NULL);
+        g_ptr_array_free (helper->fc_monitors, TRUE);
+        helper->fc_monitors = NULL;
+    }
+
     if (FcInit ())
     {
         helper->fc_monitors = g_ptr_array_new ();
@@ -346,12 +1054,15 @@ xfce_xsettings_helper_fc_init (gpointer data)
         xfce_xsettings_helper_fc_monitor (helper, FcConfigGetConfigFiles (NULL));
         xfce_xsettings_helper_fc_monitor (helper, FcConfigGetFontDirs (NULL));
 
-        xfsettings_dbg (XFSD_DEBUG_FONTCONFIG, "monitoring %d paths",
-                        helper->fc_monitors->len);
+        helper->fc_n_watches = helper->fc_monitors->len;
+
+        xfsettings_dbg (XFSD_DEBUG_FONTCONFIG, "monitoring %u paths",
+                        helper->fc_n_watches);
     }
 
     return FALSE;
 }
+#endif
 
 
 
@@ -360,81 +1071,90 @@ xfce_xsettings_helper_notify_idle (gpointer data)
 {
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
 
-    /* only update if there are screen registered */
+    /* only update if there are screen registered, all changes
+     * in the window result in a single serial bump */
     if (helper->screens != NULL)
+    {
         xfce_xsettings_helper_notify (helper);
 
+        if (helper->notify_xft_pending)
+            xfce_xsettings_helper_notify_xft (helper);
+    }
+
     helper->notify_idle_id = 0;
+    helper->notify_xft_pending = FALSE;
 
     return FALSE;
 }
 
 
 
-static gboolean
-xfce_xsettings_helper_notify_xft_idle (gpointer data)
+static void
+xfce_xsettings_helper_schedule_notify (XfceXSettingsHelper *helper,
+                                       gboolean             xft)
 {
-    XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
-
-    /* only update if there are screen registered */
-    if (helper->screens != NULL)
-        xfce_xsettings_helper_notify_xft (helper);
+    if (xft)
+        helper->notify_xft_pending = TRUE;
 
-    helper->notify_xft_idle_id = 0;
-
-    return FALSE;
+    /* the window starts at the first change and is not extended by
+     * later ones, so the delay never exceeds notify_coalesce_ms */
+    if (helper->notify_idle_id == 0)
+    {
+        if (helper->notify_coalesce_ms > 0)
+        {
+            helper->notify_idle_id = g_timeout_add (helper->notify_coalesce_ms,
+                xfce_xsettings_helper_notify_idle, helper);
+        }
+        else
+        {
+            helper->notify_idle_id = g_idle_add (xfce_xsettings_helper_notify_idle, helper);
+        }
+    }
 }
 
 
 
 static gboolean
-xfce_xsettings_helper_prop_valid (const gchar  *prop_name,
-                                  const GValue *value)
+xfce_xsettings_helper_prop_valid (const gchar *prop_name)
 {
-    /* only accept properties in valid domains */
-    if (!g_str_has_prefix (prop_name, "/Net/")
-        && !g_str_has_prefix (prop_name, "/Xft/")
-        && !g_str_has_prefix (prop_name, "/Gtk/"))
-        return FALSE;
-
-    /* notify if the property has an unsupported type */
-    if (!G_VALUE_HOLDS_BOOLEAN (value)
-        && !G_VALUE_HOLDS_INT (value)
-        && !G_VALUE_HOLDS_STRING (value))
-    {
-        g_warning ("Property \"%s\" has an unsupported type \"%s\".",
-                   prop_name, G_VALUE_TYPE_NAME (value));
-
+    /* daemon setting, not exported to the clients */
+    if (strcmp (prop_name, COALESCE_PROPERTY) == 0)
         return FALSE;
-    }
 
-    return TRUE;
+    /* only accept properties in valid domains */
+    return g_str_has_prefix (prop_name, "/Net/")
+           || g_str_has_prefix (prop_name, "/Xft/")
+           || g_str_has_prefix (prop_name, "/Gtk/");
 }
 
 
 
-static gboolean
-xfce_xsettings_helper_prop_load (gchar               *prop_name,
-                                 GValue              *value,
+static void
+xfce_xsettings_helper_prop_load (const gchar         *prop_name,
+                                 const GValue        *value,
                                  XfceXSettingsHelper *helper)
 {
     XfceXSetting *setting;
 
     /* check if the property is valid */
-    if (!xfce_xsettings_helper_prop_valid (prop_name, value))
-        return FALSE;
+    if (!xfce_xsettings_helper_prop_valid (prop_name))
+        return;
 
-    setting = g_slice_new0 (XfceXSetting);
-    setting->value = value;
+    setting = xfce_xsettings_helper_setting_insert (helper, prop_name);
     setting->last_change_serial = helper->serial;
 
-    xfsettings_dbg_filtered (XFSD_DEBUG_XSETTINGS, "prop \"%s\" loaded (type=%s)",
-                             prop_name, G_VALUE_TYPE_NAME (value));
+    if (!xfce_xsettings_helper_setting_set_value (setting, value))
+    {
+        /* notify if the property has an unsupported type */
+        g_warning ("Property \"%s\" has an unsupported type \"%s\".",
+                   prop_name, G_VALUE_TYPE_NAME (value));
 
-    g_hash_table_insert (helper->settings, prop_name, setting);
+        xfce_xsettings_helper_setting_remove (helper, prop_name);
+        return;
+    }
 
-    /* we've stolen the value */
-    return TRUE;
+    xfsettings_dbg_filtered (XFSD_DEBUG_XSETTINGS, "prop \"%s\" loaded (type=%s)",
+                             prop_name, G_VALUE_TYPE_NAME (value));
 }
 
 
@@ -446,64 +1166,75 @@ xfce_xsettings_helper_prop_changed (XfconfChannel       *channel,
                                     XfceXSettingsHelper *helper)
 {
     XfceXSetting *setting;
+    XfceXSetting  converted = { NULL, };
 
     g_return_if_fail (helper->channel == channel);
 
     xfsettings_dbg_filtered (XFSD_DEBUG_XSETTINGS, "prop \"%s\" changed (type=%s)",
                              prop_name, G_VALUE_TYPE_NAME (value));
 
+    if (strcmp (prop_name, COALESCE_PROPERTY) == 0)
+    {
+        /* applies to the next window */
+        if (value != NULL && G_VALUE_HOLDS_INT (value))
+            helper->notify_coalesce_ms = CLAMP (g_value_get_int (value), 0, COALESCE_MAX_MS);
+        else
+            helper->notify_coalesce_ms = COALESCE_DEFAULT_MS;
+
+        return;
+    }
+
+    /* leave, so not notification is scheduled */
+    if (!xfce_xsettings_helper_prop_valid (prop_name))
+        return;
+
     if (G_LIKELY (value != NULL))
     {
-        setting = g_hash_table_lookup (helper->settings, prop_name);
-        if (G_LIKELY (setting != NULL))
+        if (!xfce_xsettings_helper_setting_set_value (&converted, value))
         {
-            /* update the value, assuming the types match because
-             * you cannot changes types in xfconf without removing
-             * it first */
-            g_value_reset (setting->value);
-            g_value_copy (value, setting->value);
+            g_warning ("Property \"%s\" has an unsupported type \"%s\".",
+                       prop_name, G_VALUE_TYPE_NAME (value));
 
-            /* update the serial */
-            setting->last_change_serial = helper->serial;
+            /* drop the setting, notify only if it was exported */
+            if (!xfce_xsettings_helper_setting_remove (helper, prop_name))
+               return;
         }
-        else if (xfce_xsettings_helper_prop_valid (prop_name, value))
+        else
         {
-            /* insert a new setting */
-            setting = g_slice_new0 (XfceXSetting);
-            setting->value = g_new0 (GValue, 1);
-            setting->last_change_serial = helper->serial;
+            setting = xfce_xsettings_helper_setting_lookup (helper, prop_name);
+            if (setting == NULL)
+            {
+                /* insert a new setting */
+                setting = xfce_xsettings_helper_setting_insert (helper, prop_name);
+            }
+            else if (setting->type != converted.type)
+            {
+                /* the type byte is not patched in place */
+                helper->notify->layout_dirty = TRUE;
+            }
 
-            g_value_init (setting->value, G_VALUE_TYPE (value));
-            g_value_copy (value, setting->value);
+            /* take over the value */
+            xfce_xsettings_helper_setting_clear (setting);
+            setting->type = converted.type;
+            setting->value = converted.value;
 
-            g_hash_table_insert (helper->settings, g_strdup (prop_name), setting);
-        }
-        else
-        {
-           /* leave, so not notification is scheduled */
-           return;
-        }
-    }
-    else
-    {
-        /* maybe the value is not found, because we haven't
-         * checked if the property is valid, but that's not
-         * a problem */
-        g_hash_table_remove (helper->settings, prop_name);
-    }
+            /* update the serial */
+            setting->last_change_serial = helper->serial;
 
-    if (helper->notify_idle_id == 0)
-    {
-        /* schedule an update */
-        helper->notify_idle_id = g_idle_add (xfce_xsettings_helper_notify_idle, helper);
+            /* patch the buffer */
+            xfce_xsettings_helper_setting_changed (helper, setting);
+        }
     }
-
-    if (helper->notify_xft_idle_id == 0
-        && (g_str_has_prefix (prop_name, "/Xft/")
-            || g_str_has_prefix (prop_name, "/Gtk/CursorTheme")))
+    else if (!xfce_xsettings_helper_setting_remove (helper, prop_name))
     {
-        helper->notify_xft_idle_id = g_idle_add (xfce_xsettings_helper_notify_xft_idle, helper);
+        /* nothing changed */
+        return;
     }
+
+    /* schedule an update */
+    xfce_xsettings_helper_schedule_notify (helper,
+        g_str_has_prefix (prop_name, "/Xft/")
+        || g_str_has_prefix (prop_name, "/Gtk/CursorTheme"));
 }
 
 
@@ -516,29 +1247,16 @@ xfce_xsettings_helper_load (XfceXSettingsHelper *helper)
     props = xfconf_channel_get_properties (helper->channel, NULL);
     if (G_LIKELY (props != NULL))
       {
-        /* steal properties and put them in the settings table */
-        g_hash_table_foreach_steal (props,
-            (GHRFunc) xfce_xsettings_helper_prop_load, helper);
+        /* copy the properties in the settings table */
+        g_hash_table_foreach (props,
+            (GHFunc) xfce_xsettings_helper_prop_load, helper);
 
-        /* destroy the remaining properties */
         g_hash_table_destroy (props);
       }
 }
 
 
 
-static void
-xfce_xsettings_helper_setting_free (gpointer data)
-{
-    XfceXSetting *setting = data;
-
-    g_value_unset (setting->value);
-    g_free (setting->value);
-    g_slice_free (XfceXSetting, setting);
-}
-
-
-
 static gint
 xfce_xsettings_helper_screen_dpi (XfceXSettingsScreen *screen)
 {
@@ -578,43 +1296,168 @@ xfce_xsettings_helper_screen_dpi (XfceXSettingsScreen *screen)
 
 
 static void
-xfce_xsettings_helper_notify_xft_update (GString      *resource,
-                                         const gchar  *name,
-                                         const GValue *value)
+xfce_xsettings_helper_screen_size_changed (GdkScreen           *gdkscreen,
+                                           XfceXSettingsHelper *helper)
 {
-    gchar       *found;
-    gchar       *end;
-    const gchar *str = NULL;
-    gchar        s[64];
-    gint         num;
+    GSList              *li;
+    XfceXSettingsScreen *screen;
+    gint                 dpi;
 
-    g_return_if_fail (g_str_has_suffix (name, ":"));
+    for (li = helper->screens; li != NULL; li = li->next)
+    {
+        screen = li->data;
+        if (screen->gdkscreen != gdkscreen)
+            continue;
+
+        dpi = xfce_xsettings_helper_screen_dpi (screen);
+        if (dpi != screen->dpi)
+        {
+            screen->dpi = dpi;
+
+            /* only this screen is rewritten, and only if the
+             * dpi is screen dependent */
+            if (helper->notify->dpi_offset > 0)
+                xfce_xsettings_helper_schedule_notify (helper, FALSE);
+        }
+
+        break;
+    }
+}
+
+
+
+static gchar *
+xfce_xsettings_helper_xft_get_resource (Display *xdisplay)
+{
+    Atom    type;
+    gint    format;
+    gulong  n_items;
+    gulong  bytes_after;
+    guchar *data = NULL;
+    gchar  *str = NULL;
+
+    /* XResourceManagerString() only returns the string of when the
+     * connection was opened, so query the root window property */
+    if (XGetWindowProperty (xdisplay, RootWindow (xdisplay, 0),
+                            XA_RESOURCE_MANAGER, 0, G_MAXLONG, False,
+                            XA_STRING, &type, &format, &n_items,
+                            &bytes_after, &data) == Success
+        && type == XA_STRING && format == 8)
+    {
+        str = g_strndup ((const gchar *) data, n_items);
+    }
+
+    if (data != NULL)
+        XFree (data);
+
+    return str;
+}
+
+
+
+static void
+xfce_xsettings_helper_xft_parse (XfceXSettingsHelper *helper,
+                                 const gchar         *resource)
+{
+    gchar       **lines;
+    gchar        *line;
+    gchar        *joined;
+    gchar        *key;
+    gchar        *name;
+    const gchar  *colon;
+    gpointer      idx;
+    guint         i;
 
-    /* remove the old property */
-    found = strstr (resource->str, name);
-    if (found != NULL)
+    if (helper->xft_lines != NULL)
     {
-        end = strchr (found, '\n');
-        g_string_erase (resource, found - resource->str,
-                        end != NULL ? end - found + 1 : -1);
+        g_ptr_array_foreach (helper->xft_lines, (GFunc) g_free, NULL);
+        g_ptr_array_free (helper->xft_lines, TRUE);
+        g_hash_table_destroy (helper->xft_index);
     }
 
-    switch (G_VALUE_TYPE (value))
+    helper->xft_lines = g_ptr_array_new ();
+    helper->xft_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    if (resource == NULL)
+        return;
+
+    lines = g_strsplit (resource, "\n", -1);
+    for (i = 0; lines[i] != NULL; i++)
     {
-        case G_TYPE_STRING:
-            str = g_value_get_string (value);
-            break;
+        line = g_strdup (lines[i]);
+
+        /* join escaped newlines */
+        while (g_str_has_suffix (line, "\\") && lines[i + 1] != NULL)
+        {
+            joined = g_strconcat (line, "\n", lines[++i], NULL);
+            g_free (line);
+            line = joined;
+        }
+
+        if (*line == '\0')
+        {
+            g_free (line);
+            continue;
+        }
+
+        g_ptr_array_add (helper->xft_lines, line);
+
+        /* index resources, comments are kept unindexed */
+        colon = strchr (line, ':');
+        if (colon == NULL || *line == '!')
+            continue;
+
+        key = g_strndup (line, colon - line);
+        g_strstrip (key);
+        name = g_strconcat (key, ":", NULL);
+        g_free (key);
+
+        /* the last definition wins, drop earlier ones */
+        idx = g_hash_table_lookup (helper->xft_index, name);
+        if (idx != NULL)
+        {
+            g_free (g_ptr_array_index (helper->xft_lines, GPOINTER_TO_UINT (idx) - 1));
+            g_ptr_array_index (helper->xft_lines, GPOINTER_TO_UINT (idx) - 1) = NULL;
+        }
+
+        g_hash_table_insert (helper->xft_index, name,
+                             GUINT_TO_POINTER (helper->xft_lines->len));
+    }
+
+    g_strfreev (lines);
+}
 
-        case G_TYPE_BOOLEAN:
-            str = g_value_get_boolean (value) ? "1" : "0";
+
+
+static void
+xfce_xsettings_helper_notify_xft_update (XfceXSettingsHelper *helper,
+                                         const gchar         *name,
+                                         const XfceXSetting  *setting)
+{
+    const gchar  *str = NULL;
+    gchar         s[64];
+    gint          num;
+    gpointer      idx;
+    gchar       **line = NULL;
+
+    g_return_if_fail (g_str_has_suffix (name, ":"));
+
+    idx = g_hash_table_lookup (helper->xft_index, name);
+    if (idx != NULL)
+        line = (gchar **) &g_ptr_array_index (helper->xft_lines, GPOINTER_TO_UINT (idx) - 1);
+
+    switch (setting->type)
+    {
+        case XSettingsTypeString:
+            str = setting->value.v_string;
             break;
 
-        case G_TYPE_INT:
-            num = g_value_get_int (value);
+        case XSettingsTypeInteger:
+            num = setting->value.v_int;
 
             /* -1 means default in xft, so only remove it */
             if (num == -1)
-                return;
+                break;
 
             /* special case for dpi */
             if (strcmp (name, "Xft.dpi:") == 0)
@@ -625,16 +1468,32 @@ xfce_xsettings_helper_notify_xft_update (GString      *resource,
             break;
 
         default:
-            g_assert_not_reached ();
+            /* no resource representation for colors */
+            break;
     }
 
-    if (str != NULL)
+    if (str == NULL)
     {
-        /* append a new line if required */
-        if (!g_str_has_suffix (resource->str, "\n"))
-            g_string_append_c (resource, '\n');
-
-        g_string_append_printf (resource, "%s\t%s\n", name, str);
+        /* remove the old property */
+        if (line != NULL)
+        {
+            g_free (*line);
+            *line = NULL;
+            g_hash_table_remove (helper->xft_index, name);
+        }
+    }
+    else if (line != NULL)
+    {
+        /* replace the old property */
+        g_free (*line);
+        *line = g_strdup_printf ("%s\t%s", name, str);
+    }
+    else
+    {
+        /* append the new property */
+        g_ptr_array_add (helper->xft_lines, g_strdup_printf ("%s\t%s", name, str));
+        g_hash_table_insert (helper->xft_index, g_strdup (name),
+                             GUINT_TO_POINTER (helper->xft_lines->len));
     }
 }
 
@@ -643,12 +1502,12 @@ xfce_xsettings_helper_notify_xft_update (GString      *resource,
 static void
 xfce_xsettings_helper_notify_xft (XfceXSettingsHelper *helper)
 {
-    Display      *xdisplay;
     gchar        *str;
     GString      *resource;
     XfceXSetting *setting;
     guint         i;
-    GValue        bool_val = { 0, };
+    const gchar  *line;
+    XfceXSetting  theme_core = { NULL, XSettingsTypeInteger, { 1 }, };
     const gchar  *props[][2] =
     {
         /* { xfconf name}, { xft name } */
@@ -667,41 +1526,55 @@ xfce_xsettings_helper_notify_xft (XfceXSettingsHelper *helper)
     if (G_LIKELY (helper->screens == NULL))
         return;
 
-    xdisplay = XOpenDisplay (NULL);
-    g_return_if_fail (xdisplay != NULL);
+    gdk_error_trap_push ();
+
+    /* only parse the resource string again if someone
+     * else (xrdb) changed it since our last write */
+    str = xfce_xsettings_helper_xft_get_resource (helper->xdisplay);
+    if (helper->xft_lines == NULL
+        || g_strcmp0 (str, helper->xft_written) != 0)
+    {
+        xfce_xsettings_helper_xft_parse (helper, str);
 
-    /* get the resource string from this display from screen zero */
-    str = XResourceManagerString (xdisplay);
-    resource = g_string_new (str);
+        xfsettings_dbg_filtered (XFSD_DEBUG_XSETTINGS, "resource manager parsed (%d lines)",
+                                 helper->xft_lines->len);
+    }
 
     /* update/insert the properties */
     for (i = 0; i < G_N_ELEMENTS (props); i++)
     {
-        setting = g_hash_table_lookup (helper->settings, props[i][0]);
+        setting = xfce_xsettings_helper_setting_lookup (helper, props[i][0]);
         if (G_LIKELY (setting != NULL))
         {
-            xfce_xsettings_helper_notify_xft_update (resource, props[i][1],
-                                                     setting->value);
+            xfce_xsettings_helper_notify_xft_update (helper, props[i][1],
+                                                     setting);
         }
     }
 
     /* set for Xcursor.theme */
-    g_value_init (&bool_val, G_TYPE_BOOLEAN);
-    g_value_set_boolean (&bool_val, TRUE);
-    xfce_xsettings_helper_notify_xft_update (resource, "Xcursor.theme_core:", &bool_val);
-    g_value_unset (&bool_val);
+    xfce_xsettings_helper_notify_xft_update (helper, "Xcursor.theme_core:", &theme_core);
 
-    gdk_error_trap_push ();
+    resource = g_string_new (NULL);
+    for (i = 0; i < helper->xft_lines->len; i++)
+    {
+        line = g_ptr_array_index (helper->xft_lines, i);
+        if (line != NULL)
+        {
+            g_string_append (resource, line);
+            g_string_append_c (resource, '\n');
+        }
+    }
 
     /* set the new resource manager string */
-    XChangeProperty (xdisplay,
-                     RootWindow (xdisplay, 0),
-                     XA_RESOURCE_MANAGER, XA_STRING, 8,
-                     PropModeReplace,
-                     (guchar *) resource->str,
-                     resource->len);
-
-    XCloseDisplay (xdisplay);
+    if (g_strcmp0 (str, resource->str) != 0)
+    {
+        XChangeProperty (helper->xdisplay,
+                         RootWindow (helper->xdisplay, 0),
+                         XA_RESOURCE_MANAGER, XA_STRING, 8,
+                         PropModeReplace,
+                         (guchar *) resource->str,
+                         resource->len);
+    }
 
     if (gdk_error_trap_pop () != 0)
         g_critical ("Failed to update the resource manager string");
@@ -710,53 +1583,34 @@ xfce_xsettings_helper_notify_xft (XfceXSettingsHelper *helper)
                     "resource manager (xft) changed (len=%"G_GSIZE_FORMAT")",
                     resource->len);
 
-    g_string_free (resource, TRUE);
+    g_free (str);
+    g_free (helper->xft_written);
+    helper->xft_written = g_string_free (resource, FALSE);
 }
 
 
 
-static void
-xfce_xsettings_helper_setting_append (const gchar         *name,
-                                      XfceXSetting        *setting,
-                                      XfceXSettingsNotify *notify)
+static gsize
+xfce_xsettings_helper_setting_size (const XfceXSetting *setting)
 {
-    gsize        buf_len, new_len;
-    gsize        name_len, name_len_pad;
-    gsize        value_len, value_len_pad;
-    const gchar *str = NULL;
-    guchar      *needle;
-    guchar       type = 0;
-    gint         num;
+    gsize buf_len;
 
-    name_len = strlen (name) - 1 /* -1 for the xfconf slash */;
-    name_len_pad = XSETTINGS_PAD (name_len, 4);
-
-    buf_len = 8 + name_len_pad;
-    value_len_pad = value_len = 0;
+    /* header, padded name and serial, minus 1 for the xfconf slash */
+    buf_len = 8 + XSETTINGS_PAD (strlen (setting->name) - 1, 4);
 
-    /* get the total size of this setting */
-    switch (G_VALUE_TYPE (setting->value))
+    switch (setting->type)
     {
-        case G_TYPE_INT:
-        case G_TYPE_BOOLEAN:
-            type = XSettingsTypeInteger;
+        case XSettingsTypeInteger:
             buf_len += 4;
             break;
 
-        case G_TYPE_STRING:
-            type = XSettingsTypeString;
+        case XSettingsTypeString:
             buf_len += 4;
-            str = g_value_get_string (setting->value);
-            if (str != NULL)
-            {
-                value_len = strlen (str);
-                value_len_pad = XSETTINGS_PAD (value_len, 4);
-                buf_len += value_len_pad;
-            }
+            if (setting->value.v_string != NULL)
+                buf_len += XSETTINGS_PAD (strlen (setting->value.v_string), 4);
             break;
 
-        case G_TYPE_INT64 /* TODO */:
-            type = XSettingsTypeColor;
+        case XSettingsTypeColor:
             buf_len += 8;
             break;
 
@@ -765,50 +1619,29 @@ xfce_xsettings_helper_setting_append (const gchar         *name,
             break;
     }
 
-    /* additional length for this setting */
-    new_len = notify->buf_len + buf_len;
-
-    /* resize the buffer to fit this setting */
-    notify->buf = g_renew (guchar, notify->buf, new_len);
-    if (G_UNLIKELY (notify->buf == NULL))
-      return;
-    needle = notify->buf + notify->buf_len;
-    notify->buf_len = new_len;
-
-    /* setting record:
-     *
-     * 1  SETTING_TYPE  type
-     * 1                unused
-     * 2  n             name-len
-     * n  STRING8       name
-     * P                unused, p=pad(n)
-     * 4  CARD32        last-change-serial
-     */
-
-    /* setting type */
-    *needle++ = type;
+    return buf_len;
+}
 
-    /* unused */
-    *needle++ = 0;
 
-    /* name length */
-    *(CARD16 *)needle = name_len;
-    needle += 2;
 
-    /* name */
-    memcpy (needle, name + 1 /* +1 for the xfconf slash */, name_len);
-    needle += name_len;
+static void
+xfce_xsettings_helper_setting_write_value (XfceXSetting        *setting,
+                                           XfceXSettingsNotify *notify)
+{
+    gsize        value_len, value_len_pad;
+    const gchar *str;
+    guchar      *needle;
+    gint         num;
 
-    /* zero the padding */
-    for (; name_len_pad > name_len; name_len_pad--)
-        *needle++ = 0;
+    /* the serial is stored right before the value */
+    needle = notify->buf + setting->value_offset - 4;
 
     /* setting's last change serial */
     *(CARD32 *)needle = setting->last_change_serial;
     needle += 4;
 
     /* set setting value */
-    switch (type)
+    switch (setting->type)
     {
         case XSettingsTypeString:
             /* body for XSettingsTypeString:
@@ -817,12 +1650,16 @@ xfce_xsettings_helper_setting_append (const gchar         *name,
              * n  STRING8  value
              * P           unused, p=pad(n)
              */
-            if (G_LIKELY (value_len > 0 && str != NULL))
-            {
-                /* value length */
-                *(CARD32 *)needle = value_len;
-                needle += 4;
+            str = setting->value.v_string;
+            value_len = str != NULL ? strlen (str) : 0;
+            value_len_pad = XSETTINGS_PAD (value_len, 4);
+
+            /* value length */
+            *(CARD32 *)needle = value_len;
+            needle += 4;
 
+            if (G_LIKELY (value_len > 0))
+            {
                 /* value */
                 memcpy (needle, str, value_len);
                 needle += value_len;
@@ -831,12 +1668,6 @@ xfce_xsettings_helper_setting_append (const gchar         *name,
                 for (; value_len_pad > value_len; value_len_pad--)
                     *needle++ = 0;
             }
-            else
-            {
-                /* value length */
-                *(CARD32 *)needle = 0;
-                needle += 4;
-            }
             break;
 
         case XSettingsTypeInteger:
@@ -844,44 +1675,45 @@ xfce_xsettings_helper_setting_append (const gchar         *name,
              *
              * 4  INT32  value
              */
-            if (G_VALUE_TYPE (setting->value) == G_TYPE_INT)
-            {
-                num = g_value_get_int (setting->value);
+            num = setting->value.v_int;
 
-                /* special case handling for DPI */
-                if (strcmp (name, "/Xft/DPI") == 0)
+            /* special case handling for DPI */
+            if (strcmp (setting->name, "/Xft/DPI") == 0)
+            {
+                /* remember the offset for screen dependend dpi
+                 * or clamp the value and set 1/1024ths of an inch
+                 * for Xft */
+                if (num < 1)
                 {
-                    /* remember the offset for screen dependend dpi
-                     * or clamp the value and set 1/1024ths of an inch
-                     * for Xft */
-                    if (num < 1)
-                        notify->dpi_offset = needle - notify->buf;
-                    else
-                        num = CLAMP (num, DPI_LOW_REASONABLE, DPI_HIGH_REASONABLE) * 1024;
+                    notify->dpi_offset = needle - notify->buf;
+                    notify->buf_dpi = 0;
+                }
+                else
+                {
+                    notify->dpi_offset = 0;
+                    num = CLAMP (num, DPI_LOW_REASONABLE, DPI_HIGH_REASONABLE) * 1024;
                 }
-            }
-            else
-            {
-                num = g_value_get_boolean (setting->value);
             }
 
             *(INT32 *)needle = num;
             needle += 4;
             break;
 
-        /* TODO */
         case XSettingsTypeColor:
             /* body for XSettingsTypeColor:
             *
             * 2  CARD16  red
-            * 2  CARD16  blue
             * 2  CARD16  green
+            * 2  CARD16  blue
             * 2  CARD16  alpha
+            *
+            * the spec table lists blue before green, but GTK and
+            * every other client read the components in rgba order
             */
-            *(CARD16 *)needle = 0;
-            *(CARD16 *)(needle + 2) = 0;
-            *(CARD16 *)(needle + 4) = 0;
-            *(CARD16 *)(needle + 6) = 0;
+            *(CARD16 *)needle = setting->value.v_color[0];
+            *(CARD16 *)(needle + 2) = setting->value.v_color[1];
+            *(CARD16 *)(needle + 4) = setting->value.v_color[2];
+            *(CARD16 *)(needle + 6) = setting->value.v_color[3];
             needle += 8;
             break;
 
@@ -889,6 +1721,56 @@ xfce_xsettings_helper_setting_append (const gchar         *name,
             g_assert_not_reached ();
             break;
     }
+}
+
+
+
+static void
+xfce_xsettings_helper_setting_append (XfceXSetting        *setting,
+                                      XfceXSettingsNotify *notify)
+{
+    gsize   name_len, name_len_pad;
+    guchar *needle;
+
+    name_len = strlen (setting->name) - 1 /* -1 for the xfconf slash */;
+    name_len_pad = XSETTINGS_PAD (name_len, 4);
+
+    /* the buffer has been sized for all settings by the caller */
+    needle = notify->buf + notify->buf_len;
+    setting->size = xfce_xsettings_helper_setting_size (setting);
+    notify->buf_len += setting->size;
+
+    /* setting record:
+     *
+     * 1  SETTING_TYPE  type
+     * 1                unused
+     * 2  n             name-len
+     * n  STRING8       name
+     * P                unused, p=pad(n)
+     * 4  CARD32        last-change-serial
+     */
+
+    /* setting type */
+    *needle++ = setting->type;
+
+    /* unused */
+    *needle++ = 0;
+
+    /* name length */
+    *(CARD16 *)needle = name_len;
+    needle += 2;
+
+    /* name */
+    memcpy (needle, setting->name + 1 /* +1 for the xfconf slash */, name_len);
+    needle += name_len;
+
+    /* zero the padding */
+    for (; name_len_pad > name_len; name_len_pad--)
+        *needle++ = 0;
+
+    /* serial and value */
+    setting->value_offset = needle + 4 - notify->buf;
+    xfce_xsettings_helper_setting_write_value (setting, notify);
 
     notify->n_settings++;
 }
@@ -896,23 +1778,47 @@ xfce_xsettings_helper_setting_append (const gchar         *name,
 
 
 static void
-xfce_xsettings_helper_notify (XfceXSettingsHelper *helper)
+xfce_xsettings_helper_setting_changed (XfceXSettingsHelper *helper,
+                                       XfceXSetting        *setting)
 {
-    XfceXSettingsNotify *notify;
+    XfceXSettingsNotify *notify = helper->notify;
+
+    /* a relayout is already pending, that will pick up the value */
+    if (notify->layout_dirty)
+        return;
+
+    /* patch the record in place if its size did not change, this
+     * is always the case for integers and often for strings */
+    if (xfce_xsettings_helper_setting_size (setting) == setting->size)
+    {
+        xfce_xsettings_helper_setting_write_value (setting, notify);
+        notify->content_serial++;
+    }
+    else
+    {
+        notify->layout_dirty = TRUE;
+    }
+}
+
+
+
+static void
+xfce_xsettings_helper_relayout (XfceXSettingsHelper *helper)
+{
+    XfceXSettingsNotify *notify = helper->notify;
     CARD32               orderint = 0x01020304;
-    guchar              *needle;
-    XfceXSettingsScreen *screen;
-    GSList              *li;
-    gint                 dpi;
+    gsize                buf_len = 12;
+    guint                i;
 
-    g_return_if_fail (XFCE_IS_XSETTINGS_HELPER (helper));
+    /* compute the size of all settings so we allocate only once */
+    for (i = 0; i < helper->settings->len; i++)
+        buf_len += xfce_xsettings_helper_setting_size (&g_array_index (helper->settings, XfceXSetting, i));
 
-    notify = g_slice_new0 (XfceXSettingsNotify);
-    notify->buf = g_new0 (guchar, 12);
-    if (G_UNLIKELY (notify->buf == NULL))
-      goto errnomem;
+    g_free (notify->buf);
+    notify->buf = g_new0 (guchar, buf_len);
     notify->buf_len = 12;
-    needle = notify->buf;
+    notify->n_settings = 0;
+    notify->dpi_offset = 0;
 
     /* general notification form:
      *
@@ -923,22 +1829,64 @@ xfce_xsettings_helper_notify (XfceXSettingsHelper *helper)
      */
 
     /* byte-order */
-    *(CARD8 *)needle = (*(char *)&orderint == 1) ? MSBFirst : LSBFirst;
-    needle += 4;
-
-    /* serial for this notification */
-    *(CARD32 *)needle = helper->serial++;
+    *(CARD8 *)notify->buf = (*(char *)&orderint == 1) ? MSBFirst : LSBFirst;
 
     /* add all the settings */
-    g_hash_table_foreach (helper->settings,
-        (GHFunc) xfce_xsettings_helper_setting_append, notify);
+    for (i = 0; i < helper->settings->len; i++)
+        xfce_xsettings_helper_setting_append (&g_array_index (helper->settings, XfceXSetting, i), notify);
 
-    if (G_UNLIKELY (notify->buf == NULL))
-      goto errnomem;
+    g_assert (notify->buf_len == buf_len);
 
     /* number of settings */
-    needle = notify->buf + 8;
-    *(CARD32 *)needle = notify->n_settings;
+    *(CARD32 *)(notify->buf + 8) = notify->n_settings;
+
+    notify->layout_dirty = FALSE;
+    notify->content_serial++;
+
+    xfsettings_dbg_filtered (XFSD_DEBUG_XSETTINGS, "buffer relayout (len=%"G_GSIZE_FORMAT")",
+                             notify->buf_len);
+}
+
+
+
+static gboolean
+xfce_xsettings_helper_screen_outdated (XfceXSettingsNotify *notify,
+                                       XfceXSettingsScreen *screen)
+{
+    if (screen->written_content_serial != notify->content_serial)
+        return TRUE;
+
+    /* same settings, but the screen dpi can differ */
+    return notify->dpi_offset > 0 && screen->written_dpi != screen->dpi;
+}
+
+
+
+static void
+xfce_xsettings_helper_notify (XfceXSettingsHelper *helper)
+{
+    XfceXSettingsNotify *notify;
+    XfceXSettingsScreen *screen;
+    GSList              *li;
+    guint                n_written = 0;
+
+    g_return_if_fail (XFCE_IS_XSETTINGS_HELPER (helper));
+
+    /* only rebuild the buffer if the layout changed, value
+     * changes have already been patched in place */
+    notify = helper->notify;
+    if (notify->layout_dirty)
+        xfce_xsettings_helper_relayout (helper);
+
+    /* leave if all the screens already have these bytes */
+    for (li = helper->screens; li != NULL; li = li->next)
+        if (xfce_xsettings_helper_screen_outdated (notify, li->data))
+            break;
+    if (li == NULL)
+        return;
+
+    /* serial for this notification */
+    *(CARD32 *)(notify->buf + 4) = helper->serial++;
 
     gdk_error_trap_push ();
 
@@ -947,17 +1895,23 @@ xfce_xsettings_helper_notify (XfceXSettingsHelper *helper)
     {
         screen = li->data;
 
+        if (!xfce_xsettings_helper_screen_outdated (notify, screen))
+            continue;
+
         /* set the accurate dpi for this screen */
-        if (notify->dpi_offset > 0)
+        if (notify->dpi_offset > 0 && notify->buf_dpi != screen->dpi)
         {
-            dpi = xfce_xsettings_helper_screen_dpi (screen);
-            needle = notify->buf + notify->dpi_offset;
-            *(INT32 *)needle = dpi * 1024;
+            *(INT32 *)(notify->buf + notify->dpi_offset) = screen->dpi * 1024;
+            notify->buf_dpi = screen->dpi;
         }
 
         XChangeProperty (screen->xdisplay, screen->window,
                          helper->xsettings_atom, helper->xsettings_atom,
                          8, PropModeReplace, notify->buf, notify->buf_len);
+
+        screen->written_content_serial = notify->content_serial;
+        screen->written_dpi = screen->dpi;
+        n_written++;
     }
 
     if (gdk_error_trap_pop () != 0)
@@ -966,12 +1920,8 @@ xfce_xsettings_helper_notify (XfceXSettingsHelper *helper)
     }
 
     xfsettings_dbg (XFSD_DEBUG_XSETTINGS,
-                    "%d settings changed (serial=%lu, len=%"G_GSIZE_FORMAT")",
-                    notify->n_settings, helper->serial - 1, notify->buf_len);
-
-    g_free (notify->buf);
-  errnomem:
-    g_slice_free (XfceXSettingsNotify, notify);
+                    "%d settings changed (serial=%lu, len=%"G_GSIZE_FORMAT", screens=%u)",
+                    notify->n_settings, helper->serial - 1, notify->buf_len, n_written);
 }
 
 
@@ -979,6 +1929,9 @@ xfce_xsettings_helper_notify (XfceXSettingsHelper *helper)
 static void
 xfce_xsettings_helper_screen_free (XfceXSettingsScreen *screen)
 {
+    if (screen->size_changed_id != 0)
+        g_signal_handler_disconnect (screen->gdkscreen, screen->size_changed_id);
+
     XDestroyWindow (screen->xdisplay, screen->window);
     g_slice_free (XfceXSettingsScreen, screen);
 }
@@ -1083,6 +2036,7 @@ xfce_xsettings_helper_register (XfceXSettingsHelper *helper,
     g_return_val_if_fail (helper->screens == NULL, FALSE);
 
     xdisplay = GDK_DISPLAY_XDISPLAY (gdkdisplay);
+    helper->xdisplay = xdisplay;
     helper->xsettings_atom = XInternAtom (xdisplay, "_XSETTINGS_SETTINGS", False);
 
     gdk_error_trap_push ();
@@ -1153,6 +2107,12 @@ xfce_xsettings_helper_register (XfceXSettingsHelper *helper,
             screen->selection_atom = selection_atom;
             screen->xdisplay = xdisplay;
             screen->screen_num = n;
+            screen->dpi = xfce_xsettings_helper_screen_dpi (screen);
+
+            /* recompute the dpi only when the geometry changes */
+            screen->gdkscreen = gdk_display_get_screen (gdkdisplay, n);
+            screen->size_changed_id = g_signal_connect (G_OBJECT (screen->gdkscreen),
+                "size-changed", G_CALLBACK (xfce_xsettings_helper_screen_size_changed), helper);
 
             xfsettings_dbg (XFSD_DEBUG_XSETTINGS, "%s registered on screen %d", atom_name, n);
 